@@ -1,134 +1,163 @@
 import sys
 import os
+import struct
+import zlib
 import soundfile as sf
 
-CONVOLUTION_REVERB_LARGEST_STAGE_SAMPLES = 16 * 1024
+WAV_MAX_LENGTH_SECONDS = 10
 
-FS = 48000
-WAV_MIN_LENGTH_SAMPLES = 3 * CONVOLUTION_REVERB_LARGEST_STAGE_SAMPLES
-WAV_MAX_LENGTH_SAMPLES = 10 * FS
+# IR pack (see src/BarcelonaReverbera/ConvolutionReverb/ImpulseResponses/IrPack.h), embedded in the plugin as the IrPack.bin binary resource
+IR_PACK_VERSION = 1
+IR_PACK_NAME_SIZE = 128
+IR_PACK_HEADER_SIZE = 16
+IR_PACK_ENTRY_SIZE = IR_PACK_NAME_SIZE + 8 * 4
 
-NUM_EXTRA_ZEROS = CONVOLUTION_REVERB_LARGEST_STAGE_SAMPLES
+ENCODING_PCM24 = 0
+ENCODING_PCM24_DELTA_DEFLATE = 1
+
+PCM24_MAX = (1 << 23) - 1
 
 def getSignalName(wavFile):
     wavFileSplitSlashes = wavFile.split('/')
     return wavFileSplitSlashes[len(wavFileSplitSlashes)-1].split('.')[0]
 
+# 24-bit integers, and the value of 1 LSB: exact for 16/24-bit files, peak normalized for float files
+def quantize(channels, subtype):
+    if subtype in ('PCM_16', 'PCM_24'):
+        step = 1.0 / (1 << 23)
+    else:
+        peak = max(max(abs(x) for x in channel) for channel in channels)
+        step = (peak / PCM24_MAX) if (peak > 0.0) else 1.0
+
+    step = struct.unpack('<f', struct.pack('<f', step))[0] # as stored
+    return [[max(-PCM24_MAX - 1, min(PCM24_MAX, int(round(x / step)))) for x in channel] for channel in channels], step
+
+def encodePcm24(channels):
+    payload = bytearray()
+
+    for channel in channels:
+        for q in channel:
+            payload += (q & 0xFFFFFF).to_bytes(3, 'little')
+
+    return bytes(payload)
+
+# differences between consecutive samples (modulo 2^24), as 3 byte planes per channel: the decaying tail compresses well
+def encodePcm24DeltaDeflate(channels):
+    planes = bytearray()
+
+    for channel in channels:
+        deltas = []
+        previous = 0
+
+        for q in channel:
+            deltas.append((q - previous) & 0xFFFFFF)
+            previous = q
+
+        for shift in (0, 8, 16):
+            planes += bytes((delta >> shift) & 0xFF for delta in deltas)
+
+    return zlib.compress(bytes(planes), 9)
+
+def writeIrPack(packPath, irs):
+    entries = bytearray()
+    payloads = bytearray()
+    payloadOffset = IR_PACK_HEADER_SIZE + len(irs) * IR_PACK_ENTRY_SIZE
+
+    for name, channels, fs, subtype in irs:
+        quantized, step = quantize(channels, subtype)
+        payload = encodePcm24(quantized)
+        encoding = ENCODING_PCM24
+        compressed = encodePcm24DeltaDeflate(quantized)
+
+        if len(compressed) < len(payload):
+            payload = compressed
+            encoding = ENCODING_PCM24_DELTA_DEFLATE
+
+        nameBytes = name.encode('utf-8')[:IR_PACK_NAME_SIZE - 1]
+        entries += nameBytes + bytes(IR_PACK_NAME_SIZE - len(nameBytes))
+        entries += struct.pack('<IIIIfIII', len(channels), int(fs), len(channels[0]), encoding, step, payloadOffset + len(payloads), len(payload), 0)
+        payloads += payload
+
+        print(f"INFO: {name}: {len(channels)} channels, {len(channels[0])} samples at {fs} Hz, {len(payload)} bytes")
+
+    with open(packPath, 'wb') as packFile:
+        packFile.write(b'BRIR' + struct.pack('<III', IR_PACK_VERSION, len(irs), 0))
+        packFile.write(entries)
+        packFile.write(payloads)
+
 # Check the input arguments
 if len(sys.argv) < 2:
-    print("Usage: python3 convert_wav_to_c_array.py <audio_file1.wav> <audio_file2.wav> ...")
+    print("Usage: python3 ConvertWavsToCArray.py <audio_file1.wav> <audio_file2.wav> ...")
     sys.exit(1)
 
-numFiles = 0
+irs = []
+
+# Process each audio file
 for wavFile in sys.argv[1:]:
-    if wavFile.endswith('.wav'):
-        numFiles += 1
+    if not wavFile.endswith('.wav'):
+        print(f"INFO: Skipping non-wav file: {wavFile}")
+        continue
+
+    data, fs = sf.read(wavFile, always_2d=True)
+    audioLen = len(data)
 
-# Open the header file for writing
+    if audioLen == 0 or audioLen > WAV_MAX_LENGTH_SECONDS * fs:
+        print(f"ERROR: {wavFile} does not meet length requirements")
+        sys.exit(1)
+
+    numChannels = len(data[0])
+
+    # 4 channels: true stereo IR, ordered LL, LR, RL, RR (input channel, output channel)
+    if (numChannels != 1) and (numChannels != 2) and (numChannels != 4):
+        print("ERROR: Source audio file should be mono, stereo (2 channels) or true stereo (4 channels)")
+        sys.exit(1)
+
+    #trim final zeros (the engine appends its own)...
+    trimCount = 0
+    for i in range(0, audioLen):
+        index = (audioLen - 1) - i
+        if all(data[index][ch] == 0 for ch in range(0, numChannels)):
+            trimCount += 1
+        else:
+            break
+
+    audioLen -= trimCount
+
+    if audioLen == 0:
+        print(f"ERROR: {wavFile} is silent")
+        sys.exit(1)
+
+    channels = [[float(data[i][ch]) for i in range(0, audioLen)] for ch in range(0, numChannels)]
+    irs.append((getSignalName(wavFile), channels, fs, sf.info(wavFile).subtype))
+
+numFiles = len(irs)
+
+# The IR audio goes to the pack, and the header file only indexes the resources
 scriptDir = os.path.dirname(os.path.abspath(__file__))
 headerPath = os.path.join(scriptDir, 'IrBuffersAutoGenerated.h')
+packPath = os.path.join(scriptDir, '..', 'resources', 'IrPack.bin')
+
+writeIrPack(packPath, irs)
 
-# Initialize the IrBuffers class in the header file
 with open(headerPath, 'w') as headerFile:
     headerFile.write('#pragma once\n\n')
     headerFile.write('// CAUTION: THIS FILE IS AUTO-GENERATED WITH THE ConvertWavsToCArray.py TOOL, DO NOT EDIT MANUALLY!\n\n')
+    headerFile.write('// The IR names and audio are in the IrPack.bin binary resource (see IrPack.h)\n\n')
     headerFile.write('class IrBuffers\n{\n')
     headerFile.write('private:\n')
-    headerFile.write(f'    static constexpr int m_irCount = {numFiles};\n')
-    headerFile.write(f'    static constexpr int m_irBuffersExtraZeros = {NUM_EXTRA_ZEROS};\n\n')
-
-    fileIndex = 0
-
-    # Process each audio file
-    for wavFile in sys.argv[1:]:
-        if not wavFile.endswith('.wav'):
-            print(f"INFO: Skipping non-wav file: {wavFile}")
-            continue
-
-        data, fs = sf.read(wavFile)
-        audioLen = len(data)
-
-        if fs != FS:
-            print(f"ERROR: {wavFile} sample rate is not {FS} Hz")
-            sys.exit(1)
-
-        if audioLen < WAV_MIN_LENGTH_SAMPLES or audioLen > WAV_MAX_LENGTH_SAMPLES:
-            print(f"ERROR: {wavFile} does not meet length requirements")
-            sys.exit(1)
-        
-        if (len(data[0]) != 2):
-            print("ERROR: Source audio file should be stereo (2 channels)")
-            sys.exit(1)
-        
-        #trim final zeros...
-        trimCount = 0
-        for i in range(0, audioLen):
-            index = (audioLen - 1) - i
-            if ((data[index][0] == 0) and (data[index][1] == 0)):
-                trimCount += 1
-            else:
-                break
-
-        audioLen -= trimCount
-        audioPlusZerosLen = audioLen + NUM_EXTRA_ZEROS
-
-        headerFile.write(f'    float m_audioBuffer_{fileIndex}[2][{audioPlusZerosLen}] =\n')
-        headerFile.write('    {\n')
-
-        for ch in range(0, 2):
-            headerFile.write('        {\n            ')
-
-            for i in range(0, audioPlusZerosLen):
-                if (i < audioLen):
-                    headerFile.write(f'{data[i][ch]}, ')
-                else:
-                    headerFile.write('0.0, ')
-
-            headerFile.write('\n        },\n')
-
-        headerFile.write('    };\n\n')
-
-        fileIndex += 1
-
-    headerFile.write('    const char m_irNames[m_irCount][128] =\n    {\n')
-
-    # Add audio file names:
-    for wavFile in sys.argv[1:]:
-        if not wavFile.endswith('.wav'):
-            continue
-    
-        signalName = getSignalName(wavFile)
-        headerFile.write(f'        "{signalName}",\n')
-
-    headerFile.write('    };\n\n')
+    headerFile.write(f'    static constexpr int m_irCount = {numFiles};\n\n')
 
     headerFile.write('public:\n')
     headerFile.write('    static constexpr int getIrCount(void)\n    {\n        return m_irCount;\n    }\n\n')
-    headerFile.write('    char* getIrName(int irIndex)\n    {\n        if (irIndex >= m_irCount)\n            return nullptr;\n\n        return (char*) m_irNames[irIndex];\n    }\n\n')
-
-    headerFile.write('    float* getIrAudioBuffer(int irIndex, int channel)\n    {\n        if ((irIndex >= m_irCount) || (channel >= 2))\n            return nullptr;\n\n')
-    for i in range(0, numFiles):
-        headerFile.write(f'        if (irIndex == {i})\n')
-        headerFile.write('        {\n')
-        headerFile.write(f'            return m_audioBuffer_{i}[channel];\n')
-        headerFile.write('        }\n')
-    headerFile.write('        \n        return nullptr;\n    }\n')
-
-    headerFile.write('    uint32_t getIrLenWithZeros(int irIndex)\n    {\n        if (irIndex >= m_irCount)\n            return 0;\n\n')
-    for i in range(0, numFiles):
-        headerFile.write(f'        if (irIndex == {i})\n')
-        headerFile.write('        {\n')
-        headerFile.write(f'            return sizeof(m_audioBuffer_{i})/(2*sizeof(float));\n')
-        headerFile.write('        }\n')
-    headerFile.write('        \n        return 0;\n    }\n\n')
 
-    headerFile.write('    uint32_t getIrLen(int irIndex)\n    {\n        return getIrLenWithZeros(irIndex) - m_irBuffersExtraZeros;\n    }\n\n')
+    headerFile.write('    static const char* getIrPackPtr(void)\n    {\n        return BinaryData::IrPack_bin;\n    }\n\n')
+    headerFile.write('    static uint32_t getIrPackSize(void)\n    {\n        return BinaryData::IrPack_binSize;\n    }\n\n')
 
     headerFile.write('    static char* getIrImgPtr(int irIndex)\n    {\n        if (irIndex >= m_irCount)\n            return nullptr;\n\n')
     for i in range(0, numFiles):
         headerFile.write(f'        if (irIndex == {i})\n')
         headerFile.write('        {\n')
-        headerFile.write(f'            return (char*) BinaryData::IR_img_{i:02d}_jpg;\n')
+        headerFile.write(f'            return (char*) BinaryData::IR_img_{i:02d}_png;\n')
         headerFile.write('        }\n')
     headerFile.write('        \n        return nullptr;\n    }\n\n')
 
@@ -136,10 +165,10 @@ with open(headerPath, 'w') as headerFile:
     for i in range(0, numFiles):
         headerFile.write(f'        if (irIndex == {i})\n')
         headerFile.write('        {\n')
-        headerFile.write(f'            return BinaryData::IR_img_{i:02d}_jpgSize;\n')
+        headerFile.write(f'            return BinaryData::IR_img_{i:02d}_pngSize;\n')
         headerFile.write('        }\n')
     headerFile.write('        \n        return 0;\n    }\n')
 
     headerFile.write('};\n')
 
-print('Header file created! Thanks for using sbrk services')
\ No newline at end of file
+print('Header file and IR pack created! Thanks for using sbrk services')
@@ -242,8 +242,22 @@ static const unsigned char temp_binary_data_1[] =
 
 const char* IR_img_01_png = (const char*) temp_binary_data_1;
 
-//================== NewsCycle-Regular.ttf ==================
+//================== IrPack.bin ==================
 static const unsigned char temp_binary_data_2[] =
+{ 66,82,73,82,1,0,0,0,2,0,0,0,0,0,0,0,68,69,76,84,65,32,70,85,78,67,84,73,79,78,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,2,0,0,0,128,187,0,0,0,192,0,0,1,0,0,0,1,0,0,52,80,1,0,0,70,1,0,0,0,0,0,0,68,69,76,84,65,32,70,85,78,67,84,73,79,78,32,87,73,84,72,32,68,69,76,65,89,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,2,0,0,0,128,187,0,0,0,192,0,0,1,0,0,0,1,0,0,52,150,2,0,0,89,1,0,0,0,0,0,0,120,218,237,208,
+65,1,0,48,8,4,160,153,92,155,223,98,232,3,34,144,122,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,176,46,10,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+56,160,199,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,251,82,14,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,216,23,5,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,28,208,227,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,128,125,31,107,2,5,253,120,218,237,218,49,1,192,48,0,195,176,21,121,203,60,163,144,
+39,159,4,193,183,115,62,0,0,0,0,0,0,0,0,96,37,6,29,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,104,69,2,0,0,0,0,0,0,0,0,216,49,232,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,64,237,62,13,
+0,0,0,0,0,0,0,0,96,198,160,3,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,181,28,13,0,0,0,0,0,0,0,0,96,198,160,3,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,181,72,0,0,0,0,0,0,0,0,0,59,6,
+29,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,168,221,167,1,0,0,0,0,0,0,0,0,204,24,116,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,160,246,3,17,209,11,249,0,0 };
+
+const char* IrPack_bin = (const char*) temp_binary_data_2;
+
+//================== NewsCycle-Regular.ttf ==================
+static const unsigned char temp_binary_data_3[] =
 { 0,1,0,0,0,17,1,0,0,4,0,16,71,68,69,70,0,17,6,30,0,0,1,36,0,0,0,22,71,80,79,83,162,186,39,120,0,0,118,224,0,1,3,254,71,83,85,66,71,65,54,253,0,0,3,20,0,0,1,26,79,83,47,50,105,106,173,146,0,0,1,184,0,0,0,86,99,109,97,112,173,254,20,255,0,0,9,196,0,0,3,
 188,99,118,116,32,16,105,14,42,0,0,2,16,0,0,0,94,102,112,103,109,15,180,47,167,0,0,4,48,0,0,2,101,103,97,115,112,0,0,0,16,0,0,1,28,0,0,0,8,103,108,121,102,186,86,108,94,0,1,122,224,0,1,63,74,104,101,97,100,11,117,32,173,0,0,1,128,0,0,0,54,104,104,101,
 97,19,231,14,22,0,0,1,92,0,0,0,36,104,109,116,120,13,177,57,55,0,0,25,192,0,0,24,120,108,111,99,97,12,0,187,143,0,0,13,128,0,0,12,62,109,97,120,112,7,84,0,215,0,0,1,60,0,0,0,32,110,97,109,101,73,3,96,146,0,0,6,152,0,0,3,42,112,111,115,116,163,204,156,
@@ -2243,7 +2257,7 @@ static const unsigned char temp_binary_data_2[] =
 5,36,5,21,17,9,28,41,169,108,36,36,60,150,49,83,47,60,16,39,202,254,246,181,69,99,53,130,94,98,61,51,44,40,67,145,83,88,32,73,187,145,49,4,30,144,117,128,50,27,161,127,177,112,253,99,101,74,10,1,99,24,6,32,29,70,150,2,157,112,177,86,90,160,238,112,68,
 5,39,4,20,15,5,14,21,86,104,63,23,37,45,16,33,30,49,27,68,80,133,170,101,110,64,82,81,53,44,128,76,24,38,35,29,50,31,71,233,153,0,0,0,0,0 };
 
-const char* NewsCycleRegular_ttf = (const char*) temp_binary_data_2;
+const char* NewsCycleRegular_ttf = (const char*) temp_binary_data_3;
 
 
 const char* getNamedResource (const char* resourceNameUTF8, int& numBytes);
@@ -2259,6 +2273,7 @@ const char* getNamedResource (const char* resourceNameUTF8, int& numBytes)
     {
         case 0xd027c43c:  numBytes = 7445; return IR_img_00_png;
         case 0xd035dbbd:  numBytes = 8648; return IR_img_01_png;
+        case 0xe0056e4a:  numBytes = 1007; return IrPack_bin;
         case 0x07728310:  numBytes = 178732; return NewsCycleRegular_ttf;
         default: break;
     }
@@ -2271,6 +2286,7 @@ const char* namedResourceList[] =
 {
     "IR_img_00_png",
     "IR_img_01_png",
+    "IrPack_bin",
     "NewsCycleRegular_ttf"
 };
 
@@ -2278,6 +2294,7 @@ const char* originalFilenames[] =
 {
     "IR_img_00.png",
     "IR_img_01.png",
+    "IrPack.bin",
     "NewsCycle-Regular.ttf"
 };
 
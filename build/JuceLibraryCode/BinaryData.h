@@ -14,11 +14,14 @@ namespace BinaryData
     extern const char*   IR_img_01_png;
     const int            IR_img_01_pngSize = 8648;
 
+    extern const char*   IrPack_bin;
+    const int            IrPack_binSize = 1007;
+
     extern const char*   NewsCycleRegular_ttf;
     const int            NewsCycleRegular_ttfSize = 178732;
 
     // Number of elements in the namedResourceList and originalFileNames arrays.
-    const int namedResourceListSize = 3;
+    const int namedResourceListSize = 4;
 
     // Points to the start of a list of resource names.
     extern const char* namedResourceList[];
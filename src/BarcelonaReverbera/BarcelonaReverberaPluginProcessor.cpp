@@ -1,5 +1,6 @@
 #include "BarcelonaReverberaPluginProcessor.h"
 #include "BarcelonaReverberaPluginEditor.h"
+#include "IrFileProvider.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -17,7 +18,11 @@ BarcelonaReverberaAudioProcessor::BarcelonaReverberaAudioProcessor(void)
             std::make_unique<juce::AudioParameterFloat>(juce::ParameterID{"decayState", PARAMS_VERSION}, "Decay", 0.0f, 1.0f, 1.0f),
             std::make_unique<juce::AudioParameterFloat>(juce::ParameterID{"colorState", PARAMS_VERSION}, "Color", -1.0f, 1.0f, 0.0f),
             std::make_unique<juce::AudioParameterFloat>(juce::ParameterID{"dryWetState", PARAMS_VERSION}, "Dry/Wet", -1.0f, 1.0f, 0.0f),
-            std::make_unique<juce::AudioParameterInt>(juce::ParameterID{"irIndexState", PARAMS_VERSION}, "IR Index", 1, ConvolutionReverb::getIrCount(), 1)
+            std::make_unique<juce::AudioParameterInt>(juce::ParameterID{"irIndexState", PARAMS_VERSION}, "IR Index", 1, getIrLibraryCount(), 1),
+            // no DSP threads (for hosts that restrict them): saved with the session, not automatable as changing it rebuilds the reverb
+            std::make_unique<juce::AudioParameterBool>(juce::ParameterID{"threadlessState", PARAMS_VERSION}, "Threadless", false, juce::AudioParameterBoolAttributes().withAutomatable(false)),
+            // decay and color on the wet signal (see ConvolutionReverb::setDecayColorOnWetSignal()): not automatable either
+            std::make_unique<juce::AudioParameterBool>(juce::ParameterID{"lightKnobsState", PARAMS_VERSION}, "Light Knobs", false, juce::AudioParameterBoolAttributes().withAutomatable(false))
         }
     )
 {
@@ -25,6 +30,8 @@ BarcelonaReverberaAudioProcessor::BarcelonaReverberaAudioProcessor(void)
     m_colorParam = m_params.getRawParameterValue("colorState");
     m_dryWetParam = m_params.getRawParameterValue("dryWetState");
     m_irIndexParam = m_params.getRawParameterValue("irIndexState");
+    m_threadlessParam = m_params.getRawParameterValue("threadlessState");
+    m_lightKnobsParam = m_params.getRawParameterValue("lightKnobsState");
 }
 
 BarcelonaReverberaAudioProcessor::~BarcelonaReverberaAudioProcessor(void)
@@ -36,6 +43,15 @@ BarcelonaReverberaAudioProcessor::~BarcelonaReverberaAudioProcessor(void)
 void BarcelonaReverberaAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
     m_convolutionReverb.init();
+
+    // the whole reverb is built here, so that the audio thread never has to (later changes are rebuilt in the background).
+    // Any block size up to samplesPerBlock is re-blocked internally, with a constant latency (one internal block, at most
+    // BCNRVRB_REBLOCK_MAX_BLOCK_SIZE samples) reported here only.
+    // A mono input is given to the reverb as the same channel twice (see processBlock()), which it only convolves once:
+    m_convolutionReverb.setProcessingMode(getProcessingMode());
+    m_convolutionReverb.setDecayColorOnWetSignal(getLightKnobs());
+    m_convolutionReverb.prepare(sampleRate, (getTotalNumOutputChannels() > 1), (getTotalNumInputChannels() < 2), samplesPerBlock, getIrIndex(), getDecayControl(), getColorControl());
+    setLatencySamples(m_convolutionReverb.getLatencySamples());
 }
 
 void BarcelonaReverberaAudioProcessor::releaseResources(void)
@@ -53,8 +69,10 @@ bool BarcelonaReverberaAudioProcessor::isBusesLayoutSupported(const BusesLayout&
      && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
         return false;
 
-    // This checks if the input layout matches the output layout
-    if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
+    // the input layout must match the output layout, except for a mono input into a stereo output (e.g. a mono send), which the
+    // reverb only convolves once (see processBlock()):
+    if ((layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
+     && (layouts.getMainInputChannelSet() != juce::AudioChannelSet::mono()))
         return false;
 
     return true;
@@ -65,10 +83,10 @@ void BarcelonaReverberaAudioProcessor::processBlock(juce::AudioBuffer<float>& bu
     juce::ignoreUnused(midiMessages);
     juce::ScopedNoDenormals noDenormals;
 
-    const float decayControl = (m_decayParam == nullptr) ? 0.5f : static_cast<float>(*m_decayParam);
-    const float colorControl = (m_colorParam == nullptr) ? 0.5f : static_cast<float>(*m_colorParam);
+    const float decayControl = getDecayControl();
+    const float colorControl = getColorControl();
     const float dryWetControl = (m_dryWetParam == nullptr) ? 0.5f : static_cast<float>(*m_dryWetParam);
-    const int irIndex = (m_irIndexParam == nullptr) ? 0 : (static_cast<int>(*m_irIndexParam) - 1);
+    const int irIndex = getIrIndex();
 
     const int numInputChannels = getTotalNumInputChannels();
     const int numOutputChannels = getTotalNumOutputChannels();
@@ -97,11 +115,55 @@ void BarcelonaReverberaAudioProcessor::processBlock(juce::AudioBuffer<float>& bu
     outputData[0] = m_audioOutputDataBuffer[0];
     outputData[1] = m_audioOutputDataBuffer[1];
 
-    m_convolutionReverb.process(inputData, outputData, (numOutputChannels > 1), samplerate, blockSize, decayControl, colorControl, dryWetControl, irIndex);
+    // an offline bounce switches the processing mode in place (the reverb is not rebuilt):
+    m_convolutionReverb.setProcessingMode(getProcessingMode());
+    m_convolutionReverb.setDecayColorOnWetSignal(getLightKnobs());
+
+    // blocks larger than the output buffer are processed in chunks, of a multiple of the internal block size (a power of 2 up to
+    // BCNRVRB_MAX_BLOCK_SIZE). The last, shorter one is carried through the reverb's re-blocking FIFO like any other host block:
+    for (int start=0; start<blockSize; start+=BCNRVRB_MAX_BLOCK_SIZE)
+    {
+        const int chunkSize = juce::jmin(blockSize - start, BCNRVRB_MAX_BLOCK_SIZE);
+        const float* chunkInputData[2] = { inputData[0] + start, inputData[1] + start };
+
+        m_convolutionReverb.process(chunkInputData, outputData, (numOutputChannels > 1), samplerate, chunkSize, decayControl, colorControl, dryWetControl, irIndex);
+
+        std::memcpy(buffer.getWritePointer(0, start), outputData[0], chunkSize*sizeof(float));
+        if (numOutputChannels > 1)
+            std::memcpy(buffer.getWritePointer(1, start), outputData[1], chunkSize*sizeof(float));
+    }
+}
+
+// the compiled-in IRs, followed by the audio files in the user's IR folder. The folder is scanned once per process (before the first
+// instance's parameters are created), so files added later show up after restarting the host
+int BarcelonaReverberaAudioProcessor::getIrLibraryCount(void)
+{
+    static std::once_flag irLibraryScanned;
+
+    std::call_once(irLibraryScanned, [] ()
+    {
+#     if JUCE_MAC
+        const juce::File irFolder = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory).getChildFile("Application Support/BarcelonaReverbera/Impulse Responses");
+#     else
+        const juce::File irFolder = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory).getChildFile("BarcelonaReverbera/Impulse Responses");
+#     endif
+
+        IrStore::addIrProvider(std::make_unique<IrFileProvider>(irFolder));
+    });
+
+    return ConvolutionReverb::getIrCount();
+}
+
+// offline bounces: the stages are finished within every block, so that the result never depends on how fast the host runs.
+// Threadless: the larger stages are time-sliced over the blocks instead of running on the DSP thread pool
+ProcessingMode BarcelonaReverberaAudioProcessor::getProcessingMode(void) const
+{
+    const bool threadless = (m_threadlessParam != nullptr) && (*m_threadlessParam >= 0.5f);
 
-    std::memcpy(buffer.getWritePointer(0), outputData[0], blockSize*sizeof(float));
-    if (numOutputChannels > 1)
-        std::memcpy(buffer.getWritePointer(1), outputData[1], blockSize*sizeof(float));
+    if (isNonRealtime())
+        return threadless ? kProcessingMode_OfflineSingleThread : kProcessingMode_Offline;
+    else
+        return threadless ? kProcessingMode_RealtimeTimeSliced : kProcessingMode_Realtime;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -26,7 +26,7 @@ public:
     bool acceptsMidi(void) const override { return false; }
     bool producesMidi(void) const override { return false; }
     bool isMidiEffect(void) const override { return false; }
-    double getTailLengthSeconds(void) const override { return BCNRVRB_MAX_IR_LEN_SECONDS; }
+    double getTailLengthSeconds(void) const override { return m_convolutionReverb.getTailLengthSeconds(); } // follows the IR and the decay knob (hosts may only read it after prepareToPlay())
 
     int getNumPrograms(void) override { return 1; }
     int getCurrentProgram(void) override { return 0; }
@@ -37,12 +37,39 @@ public:
     void getStateInformation(juce::MemoryBlock& destData) override;
     void setStateInformation(const void* data, int sizeInBytes) override;
 
+private:
+    static int getIrLibraryCount(void);
+    ProcessingMode getProcessingMode(void) const;
+
+    inline float getDecayControl(void) const
+    {
+        return (m_decayParam == nullptr) ? 0.5f : static_cast<float>(*m_decayParam);
+    }
+
+    inline float getColorControl(void) const
+    {
+        return (m_colorParam == nullptr) ? 0.5f : static_cast<float>(*m_colorParam);
+    }
+
+    inline int getIrIndex(void) const
+    {
+        return (m_irIndexParam == nullptr) ? 0 : (static_cast<int>(*m_irIndexParam) - 1);
+    }
+
+    // Light Knobs: decay and color are applied to the wet signal, so moving them costs almost nothing
+    inline bool getLightKnobs(void) const
+    {
+        return (m_lightKnobsParam != nullptr) && (*m_lightKnobsParam >= 0.5f);
+    }
+
 private:
     juce::AudioProcessorValueTreeState m_params;
     std::atomic<float>* m_decayParam = nullptr;
     std::atomic<float>* m_colorParam = nullptr;
     std::atomic<float>* m_dryWetParam = nullptr;
     std::atomic<float>* m_irIndexParam  = nullptr;
+    std::atomic<float>* m_threadlessParam = nullptr;
+    std::atomic<float>* m_lightKnobsParam = nullptr; // decay and color on the wet signal: moving them costs almost nothing
 
     ConvolutionReverb m_convolutionReverb;
 
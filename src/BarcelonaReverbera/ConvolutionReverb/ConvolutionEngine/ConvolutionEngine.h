@@ -69,6 +69,8 @@ class ConvolutionEngine
 private:
 	uint32_t m_audioProcessingBlockSize = 0; // the general audio processing block size (not the convolution stages' block sizes)
 	uint8_t m_numChannels = 2; // 1 for mono, 2 for stereo
+	uint8_t m_numInputChannels = 2; // m_numChannels, or 1 for a mono input
+	ProcessingMode m_processingMode = kProcessingMode_Realtime;
 	
 	ConvolutionEngineDirectStage<BCNRVRB_DIRECT_STAGE_MAX_BLOCK_SIZE> m_directStage;
 
@@ -101,17 +103,76 @@ private:
 	}
 
 public:
-	inline void init(double samplerate, uint32_t audioProcessingBlockSize, uint8_t numChannels, float* ir0[2], float* ir1[2], uint32_t irLenWithoutZeros, uint32_t irLenWithZeros)
+	static inline uint32_t getDirectStageBlockSize(uint32_t audioProcessingBlockSize)
 	{
+		return (audioProcessingBlockSize < BCNRVRB_SMALLEST_STAGE_SIZE) ? BCNRVRB_SMALLEST_STAGE_SIZE : audioProcessingBlockSize;
+	}
+
+	// align IR length with longest stage's block size:
+	static inline uint32_t getIrLenPadded(uint32_t irLenWithoutZeros)
+	{
+		return ((irLenWithoutZeros % BCNRVRB_LONGEST_STAGE_SIZE) == 0)
+			? irLenWithoutZeros
+			: irLenWithoutZeros + BCNRVRB_LONGEST_STAGE_SIZE - (irLenWithoutZeros % BCNRVRB_LONGEST_STAGE_SIZE);
+	}
+
+	static inline uint32_t getIrBlockCountLg(uint32_t irLenWithoutZeros)
+	{
+		const uint32_t irLenPadded = getIrLenPadded(irLenWithoutZeros);
+
+		return (irLenPadded >= 2*BCNRVRB_LONGEST_STAGE_SIZE) ? irLenPadded / BCNRVRB_LONGEST_STAGE_SIZE - 2 : 0; // -2 because first 2 blocks are covered by smaller blocks
+	}
+
+	// called twice, with the arena in its planning and allocation passes (see MemoryArena). Only the stages used with this block size get memory
+	inline void allocateBuffers(MemoryArena& arena, uint32_t audioProcessingBlockSize, uint8_t numChannels, uint8_t numInputChannels, uint32_t irLenWithoutZeros)
+	{
+		const uint32_t irBlockCountLg = getIrBlockCountLg(irLenWithoutZeros);
+
+		m_directStage.allocateBuffers(arena, audioProcessingBlockSize, getDirectStageBlockSize(audioProcessingBlockSize), numInputChannels);
+
+		for_each_fft_stage_replacing_direct_stage([&arena, audioProcessingBlockSize, numChannels, numInputChannels, irBlockCountLg] (auto& stage)
+		{
+			stage.allocateBuffers(arena, audioProcessingBlockSize, numChannels, numInputChannels, BCNRVRB_LONGEST_STAGE_SIZE, irBlockCountLg);
+		});
+
+		for_each_fft_stage([&arena, audioProcessingBlockSize, numChannels, numInputChannels, irBlockCountLg] (auto& stage)
+		{
+			stage.allocateBuffers(arena, audioProcessingBlockSize, numChannels, numInputChannels, BCNRVRB_LONGEST_STAGE_SIZE, irBlockCountLg);
+		});
+	}
+
+	// freq. domain IR blocks, allocated apart from the rest of the buffers so that a static IR can be shared between instances (see IrStore). Same passes as allocateBuffers()
+	inline void allocateIrBlocks(MemoryArena& arena, uint32_t audioProcessingBlockSize, uint8_t numIrChannels, uint8_t irBufferCount, uint32_t irLenWithoutZeros)
+	{
+		const uint32_t irBlockCountLg = getIrBlockCountLg(irLenWithoutZeros);
+
+		for_each_fft_stage_replacing_direct_stage([&arena, audioProcessingBlockSize, numIrChannels, irBufferCount, irBlockCountLg] (auto& stage)
+		{
+			stage.allocateIrBlocks(arena, audioProcessingBlockSize, numIrChannels, irBufferCount, BCNRVRB_LONGEST_STAGE_SIZE, irBlockCountLg);
+		});
+
+		for_each_fft_stage([&arena, audioProcessingBlockSize, numIrChannels, irBufferCount, irBlockCountLg] (auto& stage)
+		{
+			stage.allocateIrBlocks(arena, audioProcessingBlockSize, numIrChannels, irBufferCount, BCNRVRB_LONGEST_STAGE_SIZE, irBlockCountLg);
+		});
+	}
+
+	// ir1 can be nullptr when the IR never changes (then only ir0 is used, and its freq. domain blocks are computed once).
+	// numIrChannels: numChannels (channel-parallel), or 4 for a true-stereo IR with stereo audio (see BCNRVRB_TRUE_STEREO_IR_CHANNEL()).
+	// numInputChannels: numChannels, or 1 when both stereo inputs are the same signal (a mono input): every stage then transforms and stores a
+	// single input, which both output channels are convolved with (process() only reads audioIn[0]).
+	// Buffers must have been allocated (allocateBuffers() and allocateIrBlocks()) with the same configuration
+	inline void init(double samplerate, uint32_t audioProcessingBlockSize, uint8_t numChannels, uint8_t numInputChannels, uint8_t numIrChannels, const float* const ir0[BCNRVRB_MAX_IR_CHANNELS], const float* const ir1[BCNRVRB_MAX_IR_CHANNELS], uint32_t irLenWithoutZeros, uint32_t irLenWithZeros, ProcessingMode processingMode)
+	{
+		m_processingMode = processingMode;
+
 		m_audioProcessingBlockSize = audioProcessingBlockSize;
 		m_numChannels = numChannels;
+		m_numInputChannels = numInputChannels;
 
-		const uint32_t directStageBlockSize = (audioProcessingBlockSize < BCNRVRB_SMALLEST_STAGE_SIZE) ? BCNRVRB_SMALLEST_STAGE_SIZE : audioProcessingBlockSize;
+		const uint32_t directStageBlockSize = getDirectStageBlockSize(audioProcessingBlockSize);
 
-		// align IR length with longest stage's block size:
-		const uint32_t irLenPadded = ((irLenWithoutZeros % BCNRVRB_LONGEST_STAGE_SIZE) == 0)
-			? irLenWithoutZeros
-			: irLenWithoutZeros + BCNRVRB_LONGEST_STAGE_SIZE - (irLenWithoutZeros % BCNRVRB_LONGEST_STAGE_SIZE);
+		const uint32_t irLenPadded = getIrLenPadded(irLenWithoutZeros);
 
 		if ((irLenPadded < irLenWithoutZeros) || (irLenPadded > irLenWithZeros))
 		{
@@ -129,19 +190,30 @@ public:
 		DEBUG_ASSERT((irBlockCountLg + 2) * BCNRVRB_LONGEST_STAGE_SIZE == irLenPadded);
 
 		if (m_audioProcessingBlockSize <= BCNRVRB_DIRECT_STAGE_MAX_BLOCK_SIZE)
-			m_directStage.init(audioProcessingBlockSize, directStageBlockSize, numChannels, ir0, ir1);
+			m_directStage.init(audioProcessingBlockSize, directStageBlockSize, numChannels, numInputChannels, numIrChannels, ir0, ir1);
 
-		for_each_fft_stage_replacing_direct_stage([samplerate, audioProcessingBlockSize, numChannels, ir0, ir1, irBlockCountLg] (auto& stage)
+		for_each_fft_stage_replacing_direct_stage([samplerate, audioProcessingBlockSize, numChannels, numInputChannels, numIrChannels, ir0, ir1, irBlockCountLg, processingMode] (auto& stage)
 		{
-			stage.init(samplerate, audioProcessingBlockSize, numChannels, ir0, ir1, BCNRVRB_LONGEST_STAGE_SIZE, irBlockCountLg);
+			stage.init(samplerate, audioProcessingBlockSize, numChannels, numInputChannels, numIrChannels, ir0, ir1, BCNRVRB_LONGEST_STAGE_SIZE, irBlockCountLg, processingMode);
 		});
 
-        for_each_fft_stage([samplerate, audioProcessingBlockSize, numChannels, ir0, ir1, irBlockCountLg] (auto& stage)
+        for_each_fft_stage([samplerate, audioProcessingBlockSize, numChannels, numInputChannels, numIrChannels, ir0, ir1, irBlockCountLg, processingMode] (auto& stage)
 		{
-			stage.init(samplerate, audioProcessingBlockSize, numChannels, ir0, ir1, BCNRVRB_LONGEST_STAGE_SIZE, irBlockCountLg);
+			stage.init(samplerate, audioProcessingBlockSize, numChannels, numInputChannels, numIrChannels, ir0, ir1, BCNRVRB_LONGEST_STAGE_SIZE, irBlockCountLg, processingMode);
 		});
 	}
 
+	// switches the processing mode in place, between process() calls (see ConvolutionEngineFftStage::setProcessingMode()). threadPool: needed
+	// by the thread pool modes, if the engine was initialized with another one
+	inline void setProcessingMode(ProcessingMode processingMode, const std::shared_ptr<DspThreadPool>& threadPool)
+	{
+		m_processingMode = processingMode;
+
+		for_each_fft_stage_replacing_direct_stage([processingMode, &threadPool] (auto& stage) { stage.setProcessingMode(processingMode, threadPool); });
+
+        for_each_fft_stage([processingMode, &threadPool] (auto& stage) { stage.setProcessingMode(processingMode, threadPool); });
+	}
+
 	inline void exit(void)
 	{
 		if (m_audioProcessingBlockSize <= BCNRVRB_DIRECT_STAGE_MAX_BLOCK_SIZE)
@@ -155,17 +227,32 @@ public:
 	inline void process(const float* __restrict audioIn[2], float* __restrict audioOut[2])
 	{
 		const uint8_t numChannels = m_numChannels;
+		const uint8_t numInputChannels = m_numInputChannels;
 		const uint32_t audioProcessingBlockSize = m_audioProcessingBlockSize;
 
 		for (uint32_t ch=0; ch<numChannels; ch++)
 			std::memset(audioOut[ch], 0, audioProcessingBlockSize*sizeof(float));
 
+		// silent input blocks: once a stage's whole input history is silent, it idles (no FFTs or MACs) until the input comes back
+		float energy = 0.0f;
+
+		for (uint32_t ch=0; ch<numInputChannels; ch++)
+		{
+			for (uint32_t i=0; i<audioProcessingBlockSize; i++)
+				energy += audioIn[ch][i] * audioIn[ch][i];
+		}
+
+		const bool inputSilent = (energy <= BCNRVRB_INPUT_SILENCE_ENERGY_PER_SAMPLE * float(numInputChannels * audioProcessingBlockSize));
+
 		if (audioProcessingBlockSize <= BCNRVRB_DIRECT_STAGE_MAX_BLOCK_SIZE)
-			m_directStage.process(audioIn, audioOut);
+			m_directStage.process(audioIn, audioOut, inputSilent);
+
+		for_each_fft_stage_replacing_direct_stage([audioIn, audioOut, inputSilent] (auto& stage) { stage.process(audioIn, audioOut, inputSilent); });
 
-		for_each_fft_stage_replacing_direct_stage([audioIn, audioOut] (auto& stage) { stage.process(audioIn, audioOut); });
+        for_each_fft_stage([audioIn, audioOut, inputSilent] (auto& stage) { stage.process(audioIn, audioOut, inputSilent); });
 
-        for_each_fft_stage([audioIn, audioOut] (auto& stage) { stage.process(audioIn, audioOut); });
+		if (m_processingMode == kProcessingMode_Offline) // the stages' jobs have been running in parallel meanwhile
+			for_each_fft_stage([] (auto& stage) { stage.joinJob(); });
 	}
 
 	inline bool canUpdateIr(void)
@@ -198,6 +285,86 @@ public:
 
 		for_each_fft_stage([irIndex] (auto& stage) { stage.updateIr(irIndex); });
 	}
+
+	inline void updateDecayGains(uint32_t decayCutPointSamples, float decayEnvSmoothingFactor)
+	{
+		m_directStage.updateDecayGains(decayCutPointSamples, decayEnvSmoothingFactor);
+
+		for_each_fft_stage_replacing_direct_stage([decayCutPointSamples, decayEnvSmoothingFactor] (auto& stage) { stage.updateDecayGains(decayCutPointSamples, decayEnvSmoothingFactor); });
+
+		for_each_fft_stage([decayCutPointSamples, decayEnvSmoothingFactor] (auto& stage) { stage.updateDecayGains(decayCutPointSamples, decayEnvSmoothingFactor); });
+	}
+
+	// deadline misses of the FFT stage with block size stageBlockSize, since construction (can be called from any thread). Only stages processed in the DSP thread pool can miss
+	inline void getDeadlineMissCounts(uint32_t stageBlockSize, uint32_t& missCount, uint32_t& missRunInlineCount)
+	{
+		missCount = 0;
+		missRunInlineCount = 0;
+
+		for_each_fft_stage([stageBlockSize, &missCount, &missRunInlineCount] (auto& stage)
+		{
+			if (stage.getBlockSize() == stageBlockSize)
+			{
+				missCount = stage.getDeadlineMissCount();
+				missRunInlineCount = stage.getDeadlineMissRunInlineCount();
+			}
+		});
+	}
+
+	// to be called (from the IR updater) before the time-domain IR buffer irIndex is rewritten: only its first irActiveLen samples are audible (the
+	// rest has been faded out by the decay), so the FFT stages' blocks after them are neither convolved nor recomputed (see updateIrBlocks())
+	inline void updateIrActiveLen(uint8_t irIndex, uint32_t irActiveLen)
+	{
+		for_each_fft_stage_replacing_direct_stage([irIndex, irActiveLen] (auto& stage) { stage.updateIrActiveLen(irIndex, irActiveLen); });
+
+		for_each_fft_stage([irIndex, irActiveLen] (auto& stage) { stage.updateIrActiveLen(irIndex, irActiveLen); });
+	}
+
+	// to be called (from the IR updater) after the time-domain IR buffer irIndex has been rewritten from firstSample onwards, before updateIr(irIndex)
+	inline void updateIrBlocks(uint8_t irIndex, uint32_t firstSample = 0)
+	{
+		for_each_fft_stage_replacing_direct_stage([irIndex, firstSample] (auto& stage) { stage.updateIrBlocks(irIndex, firstSample); });
+
+		for_each_fft_stage([irIndex, firstSample] (auto& stage) { stage.updateIrBlocks(irIndex, firstSample); });
+	}
+
+	// number of freq. domain IR blocks updateIrBlocks() recomputes, so that they can be done one at a time instead (see updateIrBlock())
+	inline uint32_t getIrBlockUpdateCount(uint8_t irIndex, uint32_t firstSample = 0)
+	{
+		uint32_t count = 0;
+
+		for_each_fft_stage_replacing_direct_stage([irIndex, firstSample, &count] (auto& stage) { count += stage.getIrBlockUpdateCount(irIndex, firstSample); });
+
+		for_each_fft_stage([irIndex, firstSample, &count] (auto& stage) { count += stage.getIrBlockUpdateCount(irIndex, firstSample); });
+
+		return count;
+	}
+
+	// the index-th of the blocks recomputed by updateIrBlocks() (index < getIrBlockUpdateCount()), same timing requirements
+	inline void updateIrBlock(uint8_t irIndex, uint32_t firstSample, uint32_t index)
+	{
+		bool done = false;
+
+		auto update = [irIndex, firstSample, &index, &done] (auto& stage)
+		{
+			if (done) // only one block is recomputed: the stages after its own are not even counted
+				return;
+
+			const uint32_t count = stage.getIrBlockUpdateCount(irIndex, firstSample);
+
+			if (index < count)
+			{
+				stage.updateIrBlock(irIndex, firstSample, index);
+				done = true;
+			}
+			else
+				index -= count;
+		};
+
+		for_each_fft_stage_replacing_direct_stage(update);
+
+		for_each_fft_stage(update);
+	}
 };
 
 ///////////////////////////////////////////////////////////////////////////////
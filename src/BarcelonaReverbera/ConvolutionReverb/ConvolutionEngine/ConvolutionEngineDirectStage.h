@@ -16,6 +16,9 @@
 
 #pragma once
 
+#include "MemoryArena.h"
+#include "ConvolutionEngineDirectStageKernels.h"
+
 ///////////////////////////////////////////////////////////////////////////////
 
 template<uint32_t _maxBlockSize>
@@ -26,69 +29,122 @@ private:
 
 private:
 	uint32_t m_audioProcessingBlockSize = 0; // the general audio processing block size
-	uint32_t m_blockSize2Blocks = 0; // direct convolution stage covers 2 initial blocks
+	uint32_t m_blockSize2Blocks = 0; // direct convolution stage covers 2 initial blocks (the number of FIR taps)
 	uint8_t m_numChannels = 2; // 1 for mono, 2 for stereo
+	uint8_t m_numInputChannels = 2; // m_numChannels, or 1 for a mono input on a stereo output (a single input history feeds both output channels)
+	uint8_t m_numIrChannels = 2; // m_numChannels, or 4 for a true-stereo IR (see BCNRVRB_TRUE_STEREO_IR_CHANNEL())
 
-	alignas(16) float m_convAccum[2][2 * m_maxBlockSize] = {}; // convolution accumulation buffer (stereo)
-	float* m_ir[2][2] = { { nullptr, nullptr } , { nullptr, nullptr } }; // impulse response (2 stereo buffers)
+	float* m_history[2] = { nullptr, nullptr }; // input history (m_numInputChannels), newest sample first: the current audio block followed by the previous m_blockSize2Blocks - 1 samples. Size: m_audioProcessingBlockSize + m_blockSize2Blocks
+	const float* m_ir[2][BCNRVRB_MAX_IR_CHANNELS] = {}; // impulse response (2 buffers of m_numIrChannels channels)
 	std::atomic<uint8_t> m_irIndex = 0; // which of the 2 IR buffers is in use
 	static_assert(std::atomic<uint8_t>::is_always_lock_free);
+	float m_irGain = 1.0f; // decay envelope gain applied to this stage's IR section
+	uint32_t m_silentSamples = 0; // consecutive silent input samples, up to m_audioProcessingBlockSize + m_blockSize2Blocks (the whole history: the stage is idle)
 
-	uint32_t m_currentPos = 0;
+	DirectStageKernels::Kernel m_kernel = nullptr; // for the current IR layout and CPU (see DirectStageKernels)
 
 public:
-	inline void init(uint32_t audioProcessingBlockSize, uint32_t blockSize, uint8_t numChannels, float* ir0[2], float* ir1[2])
+	// called twice, with the arena in its planning and allocation passes (see MemoryArena)
+	inline void allocateBuffers(MemoryArena& arena, uint32_t audioProcessingBlockSize, uint32_t blockSize, uint8_t numInputChannels)
 	{
+		const bool used = (audioProcessingBlockSize <= m_maxBlockSize);
+
+		for (uint32_t ch=0; ch<2; ch++)
+			m_history[ch] = (used && (ch < numInputChannels)) ? arena.allocate<float>(audioProcessingBlockSize + 2 * blockSize) : nullptr;
+	}
+
+	// buffers must have been allocated (allocateBuffers()) with the same configuration. numIrChannels: numChannels, or 4 for a true-stereo IR (stereo only).
+	// numInputChannels: numChannels, or 1 for a mono input (stereo only: audioIn[1] is then never read)
+	inline void init(uint32_t audioProcessingBlockSize, uint32_t blockSize, uint8_t numChannels, uint8_t numInputChannels, uint8_t numIrChannels, const float* const ir0[BCNRVRB_MAX_IR_CHANNELS], const float* const ir1[BCNRVRB_MAX_IR_CHANNELS])
+	{
+		DEBUG_ASSERT((numIrChannels == numChannels) || ((numIrChannels == 4) && (numChannels == 2)));
+		DEBUG_ASSERT((numInputChannels == numChannels) || (numInputChannels == 1));
+
 		m_audioProcessingBlockSize = audioProcessingBlockSize;
 		m_blockSize2Blocks = 2 * blockSize;
 		m_numChannels = numChannels;
-		m_currentPos = 0;
+		m_numInputChannels = numInputChannels;
+		m_numIrChannels = numIrChannels;
+		m_irIndex = 0;
+		m_irGain = 1.0f;
+		m_silentSamples = audioProcessingBlockSize + m_blockSize2Blocks; // the history starts cleared
 
-		for (int ch=0; ch<2; ch++)
+		for (int ch=0; ch<BCNRVRB_MAX_IR_CHANNELS; ch++)
 		{
-			m_ir[0][ch] = ir0[ch];
-			m_ir[1][ch] = ir1[ch];
+			m_ir[0][ch] = (ch < numIrChannels) ? ir0[ch] : nullptr;
+			m_ir[1][ch] = ((ch < numIrChannels) && (ir1 != nullptr)) ? ir1[ch] : m_ir[0][ch]; // no 2nd IR buffer: the IR is static
 		}
 
-		DEBUG_ASSERT((m_blockSize2Blocks*sizeof(float)) <= sizeof(m_convAccum[0]));
-		std::memset(m_convAccum[0], 0, m_blockSize2Blocks*sizeof(float));
-		std::memset(m_convAccum[1], 0, m_blockSize2Blocks*sizeof(float));
+		DEBUG_ASSERT(m_blockSize2Blocks <= 2 * m_maxBlockSize);
+		DEBUG_ASSERT((m_blockSize2Blocks % DirectStageKernels::kTapMultiple) == 0);
+
+		m_kernel = DirectStageKernels::select(numIrChannels);
+
+		for (uint32_t ch=0; ch<numInputChannels; ch++)
+			std::memset(m_history[ch], 0, (audioProcessingBlockSize + m_blockSize2Blocks)*sizeof(float));
 	}
 	inline void exit(void)
 	{
 	}
 
-	inline void process(const float* __restrict audioIn[2], float* __restrict audioOut[2])
+	// inputSilent: this audio block of the input is silence (see ConvolutionEngine::process())
+	inline void process(const float* __restrict audioIn[2], float* __restrict audioOut[2], bool inputSilent)
 	{
 		const uint8_t numChannels = m_numChannels;
+		const uint8_t numInputChannels = m_numInputChannels;
 		const uint32_t audioProcessingBlockSize = m_audioProcessingBlockSize;
 		const uint32_t blockSize2Blocks = m_blockSize2Blocks;
-		float* ir[2] = { m_ir[m_irIndex][0], m_ir[m_irIndex][1] };
-		uint32_t currentPos = m_currentPos;
-	
-		for (uint32_t i=0; i<audioProcessingBlockSize; i++)
+		const uint8_t irIndex = m_irIndex;
+		const uint32_t idleSamples = audioProcessingBlockSize + blockSize2Blocks;
+
+		// once the whole history is silent, it is cleared (once) and the stage outputs nothing until the input comes back:
+		if (inputSilent)
 		{
-			for (uint32_t j=0; j<blockSize2Blocks; j++)
-			{
-				uint32_t writePtr = currentPos + j;
-				if (writePtr >= blockSize2Blocks)
-					writePtr -= blockSize2Blocks;
+			if (m_silentSamples >= idleSamples)
+				return;
 
-				for (uint32_t ch=0; ch<numChannels; ch++)
-					m_convAccum[ch][writePtr] += audioIn[ch][i]*ir[ch][j];
-			}
+			m_silentSamples += audioProcessingBlockSize;
 
-			for (uint32_t ch=0; ch<numChannels; ch++)
+			if (m_silentSamples >= idleSamples)
 			{
-				audioOut[ch][i] += m_convAccum[ch][currentPos];
-				m_convAccum[ch][currentPos] = 0.0f;
+				for (uint32_t ch=0; ch<numInputChannels; ch++)
+					std::memset(m_history[ch], 0, idleSamples*sizeof(float));
+
+				return;
 			}
+		}
+		else
+		{
+			m_silentSamples = 0;
+		}
+
+		// the history moves back by one block, and the new block is written (reversed) in front of it:
+		for (uint32_t ch=0; ch<numInputChannels; ch++)
+		{
+			float* history = m_history[ch];
+
+			std::memmove(&history[audioProcessingBlockSize], history, (blockSize2Blocks - 1)*sizeof(float));
 
-			if (++currentPos == blockSize2Blocks)
-				currentPos = 0;
+			for (uint32_t i=0; i<audioProcessingBlockSize; i++)
+				history[audioProcessingBlockSize - 1 - i] = audioIn[ch][i];
 		}
 
-		m_currentPos = currentPos;
+		DirectStageKernels::Args args;
+
+		for (uint32_t ch=0; ch<BCNRVRB_MAX_IR_CHANNELS; ch++)
+			args.ir[ch] = m_ir[irIndex][ch];
+
+		for (uint32_t ch=0; ch<numChannels; ch++)
+		{
+			args.history[ch] = m_history[(numInputChannels == 1) ? 0 : ch]; // a mono input feeds both output channels
+			args.out[ch] = audioOut[ch];
+		}
+
+		args.numSamples = audioProcessingBlockSize;
+		args.numTaps = blockSize2Blocks;
+		args.gain = m_irGain;
+
+		m_kernel(args);
 	}
 
 	inline bool canUpdateIr(void)
@@ -100,6 +156,11 @@ public:
 	{
 		m_irIndex = irIndex;
 	}
+
+	inline void updateDecayGains(uint32_t decayCutPointSamples, float decayEnvSmoothingFactor)
+	{
+		m_irGain = DspUtils::getDecayEnvelopeMean(0, m_blockSize2Blocks, decayCutPointSamples, decayEnvSmoothingFactor);
+	}
 };
 
 ///////////////////////////////////////////////////////////////////////////////
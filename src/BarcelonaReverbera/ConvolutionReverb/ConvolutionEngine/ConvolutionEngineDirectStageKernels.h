@@ -0,0 +1,282 @@
+// BarcelonaReverbera - A Non-Uniform Partitioned Convolution Reverb VST3 Plugin
+// Copyright (C) 2024 sbrk devices
+//
+// This file is part of BarcelonaReverbera.
+//
+// BarcelonaReverbera is free software: you can use it and/or modify it for
+// educational and non-commercial purposes only under the terms of the
+// Custom Non-Commercial License.
+//
+// You should have received a copy of the Custom Non-Commercial License
+// along with this program. If not, see https://github.com/SbrkDevices/BarcelonaReverbera.
+//
+// For more information, please contact dani@sbrkdevices.com.
+
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "ConvolutionReverbCommon.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#	define DIRECT_STAGE_KERNELS_X86				(1)
+#	include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#	define DIRECT_STAGE_KERNELS_NEON			(1)
+#	include <arm_neon.h>
+#endif
+
+#if DIRECT_STAGE_KERNELS_X86 && (defined(__GNUC__) || defined(__clang__))
+#	define DIRECT_STAGE_KERNELS_TARGET_AVX2		__attribute__((target("avx2,fma"))) // only this function is built for AVX2 (selected at runtime)
+#else
+#	define DIRECT_STAGE_KERNELS_TARGET_AVX2		// MSVC: AVX2 intrinsics can be used without enabling them for the whole build
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+// FIR kernels of the direct stage. The input history of each channel is stored reversed (newest sample first), so every output sample
+// is a contiguous dot product between the IR (in its natural order) and the history. All the channels are processed in the same pass.
+// Mono and stereo IRs are channel-parallel, true-stereo IRs (4 channels) feed every input to both outputs (see BCNRVRB_TRUE_STEREO_IR_CHANNEL()).
+class DirectStageKernels
+{
+public:
+	struct Args
+	{
+		const float* ir[BCNRVRB_MAX_IR_CHANNELS] = {}; // numTaps each
+		const float* history[2] = {}; // reversed: history[ch][numSamples - 1 - i] is input sample i of this block, followed by the previous numTaps - 1 samples
+		float* out[2] = {}; // results are added (scaled by gain)
+		uint32_t numSamples = 0;
+		uint32_t numTaps = 0; // multiple of kTapMultiple
+		float gain = 1.0f;
+	};
+
+	typedef void (*Kernel)(const Args& args);
+
+	static constexpr uint32_t kTapMultiple = 8; // the widest vector (AVX2)
+
+	// numIrChannels: 1 (mono), 2 (stereo) or 4 (true stereo). The fastest instruction set supported by this CPU is used
+	static inline Kernel select(uint8_t numIrChannels)
+	{
+#	  if DIRECT_STAGE_KERNELS_X86
+		static const bool hasAvx2 = juce::SystemStats::hasAVX2() && juce::SystemStats::hasFMA3();
+
+		if (hasAvx2)
+			return select<ProcessAvx2>(numIrChannels);
+		else
+			return select<ProcessSse>(numIrChannels);
+#	  elif DIRECT_STAGE_KERNELS_NEON
+		return select<ProcessNeon>(numIrChannels);
+#	  else
+		return select<ProcessScalar>(numIrChannels);
+#	  endif
+	}
+
+	// reference (and fallback) implementation
+	template<uint8_t NumIrChannels>
+	static void processScalar(const Args& args)
+	{
+		const uint32_t numSamples = args.numSamples;
+		const uint32_t numTaps = args.numTaps;
+
+		for (uint32_t i=0; i<numSamples; i++)
+		{
+			const float* x0 = args.history[0] + (numSamples - 1 - i);
+			const float* x1 = args.history[(NumIrChannels > 1) ? 1 : 0] + (numSamples - 1 - i);
+			float acc0 = 0.0f;
+			float acc1 = 0.0f;
+
+			for (uint32_t j=0; j<numTaps; j++)
+			{
+				if (NumIrChannels == 4)
+				{
+					acc0 += args.ir[BCNRVRB_TRUE_STEREO_IR_CHANNEL(0, 0)][j]*x0[j] + args.ir[BCNRVRB_TRUE_STEREO_IR_CHANNEL(1, 0)][j]*x1[j];
+					acc1 += args.ir[BCNRVRB_TRUE_STEREO_IR_CHANNEL(0, 1)][j]*x0[j] + args.ir[BCNRVRB_TRUE_STEREO_IR_CHANNEL(1, 1)][j]*x1[j];
+				}
+				else
+				{
+					acc0 += args.ir[0][j]*x0[j];
+
+					if (NumIrChannels == 2)
+						acc1 += args.ir[1][j]*x1[j];
+				}
+			}
+
+			args.out[0][i] += acc0 * args.gain;
+
+			if (NumIrChannels > 1)
+				args.out[1][i] += acc1 * args.gain;
+		}
+	}
+
+#if DIRECT_STAGE_KERNELS_X86
+	template<uint8_t NumIrChannels>
+	static void processSse(const Args& args)
+	{
+		const uint32_t numSamples = args.numSamples;
+		const uint32_t numTaps = args.numTaps;
+		const float* ir[BCNRVRB_MAX_IR_CHANNELS] = { args.ir[0], args.ir[1], args.ir[2], args.ir[3] };
+
+		for (uint32_t i=0; i<numSamples; i++)
+		{
+			const float* x0 = args.history[0] + (numSamples - 1 - i);
+			const float* x1 = args.history[(NumIrChannels > 1) ? 1 : 0] + (numSamples - 1 - i);
+			__m128 acc0 = _mm_setzero_ps();
+			__m128 acc1 = _mm_setzero_ps();
+
+			for (uint32_t j=0; j<numTaps; j+=4)
+			{
+				const __m128 in0 = _mm_loadu_ps(&x0[j]);
+
+				if (NumIrChannels == 4)
+				{
+					const __m128 in1 = _mm_loadu_ps(&x1[j]);
+					acc0 = _mm_add_ps(acc0, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&ir[BCNRVRB_TRUE_STEREO_IR_CHANNEL(0, 0)][j]), in0), _mm_mul_ps(_mm_loadu_ps(&ir[BCNRVRB_TRUE_STEREO_IR_CHANNEL(1, 0)][j]), in1)));
+					acc1 = _mm_add_ps(acc1, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&ir[BCNRVRB_TRUE_STEREO_IR_CHANNEL(0, 1)][j]), in0), _mm_mul_ps(_mm_loadu_ps(&ir[BCNRVRB_TRUE_STEREO_IR_CHANNEL(1, 1)][j]), in1)));
+				}
+				else
+				{
+					acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(&ir[0][j]), in0));
+
+					if (NumIrChannels == 2)
+						acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(&ir[1][j]), _mm_loadu_ps(&x1[j])));
+				}
+			}
+
+			args.out[0][i] += sumSse(acc0) * args.gain;
+
+			if (NumIrChannels > 1)
+				args.out[1][i] += sumSse(acc1) * args.gain;
+		}
+	}
+
+	template<uint8_t NumIrChannels>
+	DIRECT_STAGE_KERNELS_TARGET_AVX2 static void processAvx2(const Args& args)
+	{
+		const uint32_t numSamples = args.numSamples;
+		const uint32_t numTaps = args.numTaps;
+		const float* ir[BCNRVRB_MAX_IR_CHANNELS] = { args.ir[0], args.ir[1], args.ir[2], args.ir[3] };
+
+		for (uint32_t i=0; i<numSamples; i++)
+		{
+			const float* x0 = args.history[0] + (numSamples - 1 - i);
+			const float* x1 = args.history[(NumIrChannels > 1) ? 1 : 0] + (numSamples - 1 - i);
+			__m256 acc0 = _mm256_setzero_ps();
+			__m256 acc1 = _mm256_setzero_ps();
+
+			for (uint32_t j=0; j<numTaps; j+=8)
+			{
+				const __m256 in0 = _mm256_loadu_ps(&x0[j]);
+
+				if (NumIrChannels == 4)
+				{
+					const __m256 in1 = _mm256_loadu_ps(&x1[j]);
+					acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(&ir[BCNRVRB_TRUE_STEREO_IR_CHANNEL(0, 0)][j]), in0, acc0);
+					acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(&ir[BCNRVRB_TRUE_STEREO_IR_CHANNEL(1, 0)][j]), in1, acc0);
+					acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(&ir[BCNRVRB_TRUE_STEREO_IR_CHANNEL(0, 1)][j]), in0, acc1);
+					acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(&ir[BCNRVRB_TRUE_STEREO_IR_CHANNEL(1, 1)][j]), in1, acc1);
+				}
+				else
+				{
+					acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(&ir[0][j]), in0, acc0);
+
+					if (NumIrChannels == 2)
+						acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(&ir[1][j]), _mm256_loadu_ps(&x1[j]), acc1);
+				}
+			}
+
+			args.out[0][i] += sumSse(_mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1))) * args.gain;
+
+			if (NumIrChannels > 1)
+				args.out[1][i] += sumSse(_mm_add_ps(_mm256_castps256_ps128(acc1), _mm256_extractf128_ps(acc1, 1))) * args.gain;
+		}
+	}
+#endif
+
+#if DIRECT_STAGE_KERNELS_NEON
+	template<uint8_t NumIrChannels>
+	static void processNeon(const Args& args)
+	{
+		const uint32_t numSamples = args.numSamples;
+		const uint32_t numTaps = args.numTaps;
+		const float* ir[BCNRVRB_MAX_IR_CHANNELS] = { args.ir[0], args.ir[1], args.ir[2], args.ir[3] };
+
+		for (uint32_t i=0; i<numSamples; i++)
+		{
+			const float* x0 = args.history[0] + (numSamples - 1 - i);
+			const float* x1 = args.history[(NumIrChannels > 1) ? 1 : 0] + (numSamples - 1 - i);
+			float32x4_t acc0 = vdupq_n_f32(0.0f);
+			float32x4_t acc1 = vdupq_n_f32(0.0f);
+
+			for (uint32_t j=0; j<numTaps; j+=4)
+			{
+				const float32x4_t in0 = vld1q_f32(&x0[j]);
+
+				if (NumIrChannels == 4)
+				{
+					const float32x4_t in1 = vld1q_f32(&x1[j]);
+					acc0 = vmlaq_f32(acc0, vld1q_f32(&ir[BCNRVRB_TRUE_STEREO_IR_CHANNEL(0, 0)][j]), in0);
+					acc0 = vmlaq_f32(acc0, vld1q_f32(&ir[BCNRVRB_TRUE_STEREO_IR_CHANNEL(1, 0)][j]), in1);
+					acc1 = vmlaq_f32(acc1, vld1q_f32(&ir[BCNRVRB_TRUE_STEREO_IR_CHANNEL(0, 1)][j]), in0);
+					acc1 = vmlaq_f32(acc1, vld1q_f32(&ir[BCNRVRB_TRUE_STEREO_IR_CHANNEL(1, 1)][j]), in1);
+				}
+				else
+				{
+					acc0 = vmlaq_f32(acc0, vld1q_f32(&ir[0][j]), in0);
+
+					if (NumIrChannels == 2)
+						acc1 = vmlaq_f32(acc1, vld1q_f32(&ir[1][j]), vld1q_f32(&x1[j]));
+				}
+			}
+
+			args.out[0][i] += sumNeon(acc0) * args.gain;
+
+			if (NumIrChannels > 1)
+				args.out[1][i] += sumNeon(acc1) * args.gain;
+		}
+	}
+#endif
+
+private:
+	// the kernel templates can't be passed as template template parameters, so each instruction set gets a selector:
+	struct ProcessScalar { template<uint8_t NumIrChannels> static constexpr Kernel get(void) { return &processScalar<NumIrChannels>; } };
+#if DIRECT_STAGE_KERNELS_X86
+	struct ProcessSse { template<uint8_t NumIrChannels> static constexpr Kernel get(void) { return &processSse<NumIrChannels>; } };
+	struct ProcessAvx2 { template<uint8_t NumIrChannels> static constexpr Kernel get(void) { return &processAvx2<NumIrChannels>; } };
+#endif
+#if DIRECT_STAGE_KERNELS_NEON
+	struct ProcessNeon { template<uint8_t NumIrChannels> static constexpr Kernel get(void) { return &processNeon<NumIrChannels>; } };
+#endif
+
+	template<typename Process>
+	static inline Kernel select(uint8_t numIrChannels)
+	{
+		DEBUG_ASSERT((numIrChannels == 1) || (numIrChannels == 2) || (numIrChannels == 4));
+
+		if (numIrChannels == 4)
+			return Process::template get<4>();
+		else if (numIrChannels == 2)
+			return Process::template get<2>();
+		else
+			return Process::template get<1>();
+	}
+
+#if DIRECT_STAGE_KERNELS_X86
+	static inline float sumSse(__m128 x)
+	{
+		const __m128 pairs = _mm_add_ps(x, _mm_movehl_ps(x, x));
+		return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+	}
+#endif
+
+#if DIRECT_STAGE_KERNELS_NEON
+	static inline float sumNeon(float32x4_t x)
+	{
+		const float32x2_t pairs = vadd_f32(vget_low_f32(x), vget_high_f32(x));
+		return vget_lane_f32(vpadd_f32(pairs, pairs), 0);
+	}
+#endif
+};
+
+///////////////////////////////////////////////////////////////////////////////
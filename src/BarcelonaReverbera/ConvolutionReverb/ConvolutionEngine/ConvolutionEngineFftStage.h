@@ -17,13 +17,13 @@
 #pragma once
 
 #include "Fft.h"
-#include "DspThread.h"
+#include "DspThreadPool.h"
+#include "MemoryArena.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 
 #define CONVOLUTION_FFT_STAGE_USES_THREAD				(1)
-
-#define ALWAYS_UPDATE_IR_BLOCKS							(1) // if enabled: uses less memory, but more processing required
+#define CONVOLUTION_FFT_STAGE_LONG_JOB_MIN_BLOCK_SIZE	(4096) // stages with this block size or larger run on the long jobs lane of the DSP thread pool
 
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -48,152 +48,276 @@ private:
 private:
 	std::atomic<uint8_t> m_numChannels = 2; // 1 for mono, 2 for stereo
 	static_assert(std::atomic<uint8_t>::is_always_lock_free);
+	uint8_t m_numInputChannels = 2; // m_numChannels, or 1 for a mono input on a stereo output (both output channels are fed by the same input spectra)
+	uint8_t m_numIrChannels = 2; // m_numChannels, or 4 for a true-stereo IR (see BCNRVRB_TRUE_STEREO_IR_CHANNEL())
 
 	uint32_t m_blockCount = m_blockCountMax; // current number of blocks in this convolution stage
 
 	uint32_t m_audioProcessingBlockSize = 0; // the general audio processing block size
+	double m_samplerate = BCNRVRB_DEFAULT_IR_SAMPLERATE;
 	bool m_skipThisStage = false; // when the audio processing block size is greater than this convolution stage's block size, no processing is done on this stage (it is only done on larger stages)
 
 	uint32_t m_convProcessingPointSamples = 0; // the point within m_blockSize when the convolution processing is done
-	bool m_processInThread = false; // indicates whether block processing is done in a separate thread
-
-	float* m_ir[2][2][m_blockCountMax] = {}; // impulse response (partitioned) (2 stereo buffers)
+	bool m_spreadOverCalls = false; // larger than the audio processing block: processed at the end of every block, while the other double buffer is in use (in every processing mode, see setProcessingMode())
+	bool m_processInThread = false; // indicates whether block processing is done in the DSP thread pool
+	bool m_joinJob = false; // kProcessingMode_Offline: the job is finished within the same engine process() call (see joinJob())
+	int64_t m_jobDeadlineNs = 0; // time from the processing point until the results are read (when the double buffer flips back)
+
+	bool m_timeSliced = false; // kProcessingMode_RealtimeTimeSliced: block processing is spread over the process() calls until its results are read, with no thread (see processSlice())
+	uint32_t m_sliceCount = 0; // process() calls per block processing (m_blockSize / m_audioProcessingBlockSize)
+	uint32_t m_sliceIndex = 0; // next slice of the current block processing (m_sliceCount: none pending)
+	uint32_t m_sliceUnit = 0; // next work unit of the current block processing (see getSliceUnitCount())
+	uint32_t m_sliceCostDone = 0; // cost of the work units already done
+	uint32_t m_sliceCostTotal = 0;
+
+	uint32_t m_jobsSubmitted = 0; // audio thread only
+	std::atomic<uint32_t> m_jobsDone = 0; // incremented at the end of every convolutionProcessOnSignal() (on whichever thread)
+	std::atomic<uint32_t> m_deadlineMissCount = 0; // jobs that had not finished when their results were needed. Never reset
+	std::atomic<uint32_t> m_deadlineMissRunInlineCount = 0; // of those, the ones no worker had started yet (run on the audio thread)
+	static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+	const float* m_ir[2][BCNRVRB_MAX_IR_CHANNELS][m_blockCountMax] = {}; // impulse response (partitioned) (2 buffers of m_numIrChannels channels)
+	uint8_t m_irBufferCount = 2; // 1 when the IR is static (no 2nd buffer to switch to)
 	std::atomic<uint8_t> m_irIndex = 0; // which of the 2 IR buffers is in use
 	static_assert(std::atomic<uint8_t>::is_always_lock_free);
 
-	alignas(16) float m_audioInputBuffer[m_numBuffers][2][m_fftSizeTimeDomain] = {}; // audio input bufffer (stereo)
-	alignas(16) float m_audioOutputBuffer[m_numBuffers][2][m_blockSize] = {}; // audio output buffer (stereo)
+	float m_irBlockGains[2][m_blockCountMax] = {}; // decay envelope gain for each IR block (double buffered), applied during the freq. domain MAC
+	std::atomic<uint8_t> m_irBlockGainsIndex = 0; // which of the 2 gain buffers is in use
+
+	// blocks convolved, for each IR buffer and gain buffer: the ones after the audible part of the decayed IR are skipped (see updateIrActiveLen()).
+	// The input delay line always keeps m_blockCount blocks, so that they can grow back at any time
+	uint32_t m_irActiveBlockCount[2] = {};
+	uint32_t m_irBlockGainsActiveCount[2] = {};
+
+	float* m_audioInputBuffer[m_numBuffers][2] = {}; // audio input bufffer (m_numInputChannels). Size: m_fftSizeTimeDomain
+	float* m_audioOutputBuffer[m_numBuffers][2] = {}; // audio output buffer (stereo). Size: m_blockSize
 	uint32_t m_audioBufferPtr = 0; // position for reading/writing into/from m_audioInputBuffer/m_audioOutputBuffer
 	uint8_t m_audioReadWriteBufferIndex = 0; // index for double buffering (read/write) on m_audioInputBuffer/m_audioOutputBuffer
 	std::atomic<uint8_t> m_audioProcessBufferIndex = 1; // index for double buffering (process) on m_audioInputBuffer/m_audioOutputBuffer
 	static_assert(std::atomic<uint8_t>::is_always_lock_free);
 
-	alignas(16) cplx_f32 m_AUDIO_IN_BLOCKS[2][m_blockCountMax][m_fftFreqDomainMultiDimBufSize] = {}; // last blocks of audio input (stereo), in freq-domain
+	bool m_audioInputSilent[m_numBuffers] = {}; // whether each input buffer only holds silence so far (see ConvolutionEngine::process()) (audio thread only)
+	bool m_audioOutputSilent[m_numBuffers] = {}; // whether each output buffer is all zeros (block processing only)
+	uint32_t m_silentBlockCount = 0; // consecutive silent input blocks, up to m_blockCount + 1, including the one being processed. Written at the processing point, before the block processing starts
+
+	cplx_f32* m_AUDIO_IN_BLOCKS = nullptr; // last blocks of audio input, in freq-domain: [m_numInputChannels][m_blockCount][m_fftFreqDomainMultiDimBufSize]. With a true-stereo IR or a mono input, each input block feeds both outputs
 	uint32_t m_audioInBlocksWritePtr = 0; // block write pointer for m_AUDIO_IN_BLOCKS
 
-	alignas(16) float m_irBlock[m_fftSizeTimeDomain] = {}; // next block of the IR in time-domain, after processing, ready to FFT it.
-# if ALWAYS_UPDATE_IR_BLOCKS
-	alignas(16) cplx_f32 m_IR_BLOCK[m_fftSizeFreqDomain] = {}; // next block of the IR in freq. domain
-# else
-	alignas(16) cplx_f32 m_IR_BLOCKS[2][m_blockCountMax][m_fftFreqDomainMultiDimBufSize] = {}; // IR blocks (stereo) in freq. domain
-# endif
+	cplx_f32* m_IR_BLOCKS = nullptr; // IR blocks in freq. domain, for all IR buffers: [m_irBufferCount][m_numIrChannels][m_blockCount][m_fftFreqDomainMultiDimBufSize]. Only written by the IR updater. May be shared with other instances when the IR is static (see IrStore)
+	float* m_irBlock = nullptr; // block of the IR in time-domain, ready to FFT it (IR updater only). Size: m_fftSizeTimeDomain
+	float* m_dataFftWorkIr = nullptr; // internal working buffer for the IR FFT class (IR updater only). Size: m_fftSizeTimeDomain
+	Fft<true, false> m_fftIr; // forward FFT for the IR blocks (IR updater only)
+
+	uint8_t m_convIrIndex = 0; // IR buffer, decay gains and blocks used by the current block processing (latched when it starts)
+	const float* m_convIrBlockGains = nullptr;
+	uint32_t m_convBlockCount = 0;
 
-	alignas(16) cplx_f32 m_CONV[m_fftSizeFreqDomain] = {}; // accumulator for the convolution result in freq. domain
-	alignas(16) float m_conv[m_fftSizeTimeDomain] = {}; // stores the convolution result in time domain
+	cplx_f32* m_CONV = nullptr; // accumulator for the convolution result in freq. domain. Size: m_fftSizeFreqDomain
+	float* m_conv = nullptr; // stores the convolution result in time domain. Size: m_fftSizeTimeDomain
 
-	alignas(16) float m_overlap[2][m_blockSize]; // overlap section (stereo) of the time-domain convolution buffer (saved to be OLA-ed in next convolution)
+	float* m_overlap[2] = {}; // overlap section (stereo) of the time-domain convolution buffer (saved to be OLA-ed in next convolution). Size: m_blockSize
 
-	alignas(16) float m_dataFftWork[m_fftSizeTimeDomain] = {}; // internal working buffer for FFT/IFFT classes
-# if !ALWAYS_UPDATE_IR_BLOCKS
-	bool m_mustUpdateIrBlocks = true; // indicates that time-domain IR has changed, so freq-domain blocks must be updated
-# endif
+	float* m_dataFftWork = nullptr; // internal working buffer for FFT/IFFT classes. Size: m_fftSizeTimeDomain
 
 	Fft<true, false> m_fft; // forward FFT
 	Fft<false, false> m_ifft; // inverse FFT
 
-	DspThread m_thread;
+	DspJob m_job;
+	std::shared_ptr<DspThreadPool> m_threadPool; // acquired on first use, kept until destruction
 
 public:
-	ConvolutionEngineFftStage(void) : m_thread(juce::String("ConvolutionFftStage_") + juce::String(m_blockSize), [this] () { convolutionInit(); }, [this] () { convolutionExit(); }, [this] () { convolutionProcessOnSignal(); }) {}
+	ConvolutionEngineFftStage(void) : m_job((m_blockSize >= CONVOLUTION_FFT_STAGE_LONG_JOB_MIN_BLOCK_SIZE) ? DspJob::kLane_Long : DspJob::kLane_Short, [this] () { convolutionProcessOnSignal(); }) {}
+
+	~ConvolutionEngineFftStage(void)
+	{
+		if (m_threadPool != nullptr)
+			m_threadPool->wait(m_job);
+	}
 
 public:
-	inline void init(double samplerate, uint32_t audioProcessingBlockSize, uint8_t numChannels, float* ir0[2], float* ir1[2], uint32_t longestStageBlockSize, uint32_t longestStageBlockCount)
+	// called twice, with the arena in its planning and allocation passes (see MemoryArena). Skipped stages get no memory at all. The freq. domain IR blocks are allocated separately (allocateIrBlocks())
+	inline void allocateBuffers(MemoryArena& arena, uint32_t audioProcessingBlockSize, uint8_t numChannels, uint8_t numInputChannels, uint32_t longestStageBlockSize, uint32_t longestStageBlockCount)
 	{
+		const bool skipThisStage = isSkipped(audioProcessingBlockSize);
+		const uint32_t blockCount = getBlockCount(longestStageBlockSize, longestStageBlockCount);
+
+		for (uint32_t b=0; b<m_numBuffers; b++)
+		{
+			for (uint32_t ch=0; ch<2; ch++)
+			{
+				m_audioInputBuffer[b][ch] = (!skipThisStage && (ch < numInputChannels)) ? arena.allocate<float>(m_fftSizeTimeDomain) : nullptr;
+				m_audioOutputBuffer[b][ch] = (!skipThisStage && (ch < numChannels)) ? arena.allocate<float>(m_blockSize) : nullptr;
+			}
+		}
+
+		for (uint32_t ch=0; ch<2; ch++)
+			m_overlap[ch] = (!skipThisStage && (ch < numChannels)) ? arena.allocate<float>(m_blockSize) : nullptr;
+
+		if (skipThisStage)
+		{
+			m_AUDIO_IN_BLOCKS = nullptr;
+			m_irBlock = nullptr;
+			m_dataFftWorkIr = nullptr;
+			m_CONV = nullptr;
+			m_conv = nullptr;
+			m_dataFftWork = nullptr;
+
+			return;
+		}
+
+		m_AUDIO_IN_BLOCKS = arena.allocate<cplx_f32>(numInputChannels * blockCount * m_fftFreqDomainMultiDimBufSize);
+		m_irBlock = arena.allocate<float>(m_fftSizeTimeDomain);
+		m_dataFftWorkIr = arena.allocate<float>(m_fftSizeTimeDomain);
+		m_CONV = arena.allocate<cplx_f32>(m_fftSizeFreqDomain);
+		m_conv = arena.allocate<float>(m_fftSizeTimeDomain);
+		m_dataFftWork = arena.allocate<float>(m_fftSizeTimeDomain);
+	}
+
+	// same passes as allocateBuffers(). The arena may hold a shared IR (see IrStore), whose blocks are computed once and then only read
+	inline void allocateIrBlocks(MemoryArena& arena, uint32_t audioProcessingBlockSize, uint8_t numIrChannels, uint8_t irBufferCount, uint32_t longestStageBlockSize, uint32_t longestStageBlockCount)
+	{
+		m_IR_BLOCKS = !isSkipped(audioProcessingBlockSize)
+			? arena.allocate<cplx_f32>(irBufferCount * numIrChannels * getBlockCount(longestStageBlockSize, longestStageBlockCount) * m_fftFreqDomainMultiDimBufSize)
+			: nullptr;
+	}
+
+	// buffers must have been allocated (allocateBuffers()) with the same configuration. numIrChannels: numChannels, or 4 for a true-stereo IR (stereo only).
+	// numInputChannels: numChannels, or 1 for a mono input (stereo only: audioIn[1] is then never read)
+	inline void init(double samplerate, uint32_t audioProcessingBlockSize, uint8_t numChannels, uint8_t numInputChannels, uint8_t numIrChannels, const float* const ir0[BCNRVRB_MAX_IR_CHANNELS], const float* const ir1[BCNRVRB_MAX_IR_CHANNELS], uint32_t longestStageBlockSize, uint32_t longestStageBlockCount, ProcessingMode processingMode)
+	{
+		DEBUG_ASSERT((numIrChannels == numChannels) || ((numIrChannels == 4) && (numChannels == 2)));
+		DEBUG_ASSERT((numInputChannels == numChannels) || (numInputChannels == 1));
+
 		m_audioProcessingBlockSize = audioProcessingBlockSize;
+		m_samplerate = samplerate;
 		m_numChannels = numChannels;
+		m_numInputChannels = numInputChannels;
+		m_numIrChannels = numIrChannels;
 
-#	  if CONVOLUTION_FFT_STAGE_USES_THREAD
-		m_processInThread = (!m_replacesDirectStage && (m_blockSize > audioProcessingBlockSize));
-#	  else
-		m_processInThread = false;
-#	  endif
+		m_spreadOverCalls = !m_replacesDirectStage && (m_blockSize > audioProcessingBlockSize);
 
-		if (m_processInThread)
-			m_convProcessingPointSamples = m_blockSize;
-		else
-			m_convProcessingPointSamples = (m_blockSize > m_audioProcessingBlockSize) ? m_blockSize / 2 : m_blockSize;
+		initProcessingMode(processingMode);
 
-		m_skipThisStage = m_replacesDirectStage
-			? (m_audioProcessingBlockSize != m_blockSize)
-			: (m_audioProcessingBlockSize > m_blockSize);
+		m_skipThisStage = isSkipped(m_audioProcessingBlockSize);
 
 		m_audioBufferPtr = 0;
 		m_audioReadWriteBufferIndex = 0;
 		m_audioProcessBufferIndex = 1;
 
-		std::memset(m_audioOutputBuffer, 0, sizeof(m_audioOutputBuffer));
-
-		for (uint32_t i=0; i<m_blockSize; i++)
+		if (!m_skipThisStage)
 		{
-			for (uint32_t ch=0; ch<2; ch++)
+			for (uint32_t b=0; b<m_numBuffers; b++)
 			{
-				for (uint32_t b=0; b<m_numBuffers; b++)
-					m_audioInputBuffer[b][ch][m_blockSize + i] = 0.0f; // 2nd half of array: zero padded for FFT IN
+				for (uint32_t ch=0; ch<numInputChannels; ch++)
+					std::memset(m_audioInputBuffer[b][ch], 0, m_fftSizeTimeDomain*sizeof(float)); // 2nd half of array: zero padded for FFT IN
+
+				for (uint32_t ch=0; ch<numChannels; ch++)
+					std::memset(m_audioOutputBuffer[b][ch], 0, m_blockSize*sizeof(float));
 			}
 		}
 
-		m_blockCount = (!m_replacesDirectStage && (longestStageBlockSize == m_blockSize)) ? longestStageBlockCount : m_blockCountMax;
+		m_blockCount = getBlockCount(longestStageBlockSize, longestStageBlockCount);
 
 		const uint32_t blockOffset = m_replacesDirectStage ? 0 : 2; // for all the FFT stages (if not replacing direct stage), blocks 0 and 1 are covered by smaller stages (in the case of the smallest FFT stage, they are covered by the direct stage)
 
+		m_irBufferCount = (ir1 != nullptr) ? 2 : 1;
+
 		for (uint32_t b=0; b<m_blockCount; b++)
 		{
-			for (int ch=0; ch<2; ch++)
+			for (uint32_t ch=0; ch<BCNRVRB_MAX_IR_CHANNELS; ch++)
 			{
-				m_ir[0][ch][b] = &ir0[ch][(b + blockOffset) * m_blockSize];
-				m_ir[1][ch][b] = &ir1[ch][(b + blockOffset) * m_blockSize];
+				m_ir[0][ch][b] = (ch < numIrChannels) ? &ir0[ch][(b + blockOffset) * m_blockSize] : nullptr;
+				m_ir[1][ch][b] = ((ch < numIrChannels) && (ir1 != nullptr)) ? &ir1[ch][(b + blockOffset) * m_blockSize] : m_ir[0][ch][b];
 			}
+
+			m_irBlockGains[0][b] = 1.0f;
+			m_irBlockGains[1][b] = 1.0f;
 		}
 
-		if (m_processInThread)
+		for (uint32_t i=0; i<2; i++)
 		{
-#		  if JUCE_MAC
-#		   if 0 // XXX does this work on Apple Silicon? Does not work on Intel...
-			m_thread.startRealtimeThread(juce::Thread::RealtimeOptions{}.withMaximumProcessingTimeMs(m_blockSize*1000.0/samplerate));
-#		   else
-			m_thread.startRealtimeThread(juce::Thread::RealtimeOptions{}.withPriority(9));
-#		   endif
-#		  else
-			//m_thread.startRealtimeThread(juce::Thread::RealtimeOptions{}.withPriority(9)); // XXX not working on linux?
-			m_thread.startThread(juce::Thread::Priority::highest);
-#		  endif
+			m_irActiveBlockCount[i] = m_blockCount;
+			m_irBlockGainsActiveCount[i] = m_blockCount;
 		}
-		else
+
+		m_irIndex = 0;
+		m_irBlockGainsIndex = 0;
+		m_convBlockCount = m_blockCount;
+
+		if (!m_skipThisStage) // m_IR_BLOCKS is not cleared here: it is zeroed when allocated, and may already hold a shared IR
+		{
+			for (uint32_t i=0; i<m_blockSize; i++)
+				m_irBlock[m_blockSize + i] = 0.0f; // 2nd half of array: zero padded for FFT IN
+
+			m_fftIr.init(m_fftSizeTimeDomain, m_dataFftWorkIr);
+		}
+
+		if (m_processInThread && (m_threadPool == nullptr))
+			m_threadPool = DspThreadPool::acquire();
+
+		if (!m_skipThisStage) // skipped stages have no buffers
 			convolutionInit();
+
+		m_jobsSubmitted = 0;
+		m_jobsDone = 0;
+	}
+
+	// switches the processing mode in place, between process() calls (the stage keeps its state). The block processing in progress, if any,
+	// is finished first: every mode processes the same blocks at the same point, so the output is as if the new mode had been used all along.
+	// threadPool: for the thread pool modes, if the stage has not acquired it yet (it is not acquired here: this is the audio thread)
+	inline void setProcessingMode(ProcessingMode processingMode, const std::shared_ptr<DspThreadPool>& threadPool)
+	{
+		if (m_processInThread && (m_jobsDone.load(std::memory_order_acquire) != m_jobsSubmitted))
+			finishJob();
+
+		while (m_sliceIndex < m_sliceCount)
+			processSlice();
+
+		initProcessingMode(processingMode);
+
+		if (m_processInThread && (m_threadPool == nullptr))
+			m_threadPool = threadPool;
+
+		DEBUG_ASSERT(!m_processInThread || (m_threadPool != nullptr));
 	}
 
 	inline void exit(void)
 	{
-		if (m_processInThread)
-			DEBUG_VERIFY(m_thread.stopThread(1000));
-		else
-			convolutionExit();
+		if (m_threadPool != nullptr) // a job may have been submitted before switching to an inline processing mode
+			m_threadPool->wait(m_job);
+
+		convolutionExit();
+
+		m_fftIr.exit();
 	}
 
-	inline void process(const float* __restrict audioIn[2] , float* __restrict audioOut[2])
+	// inputSilent: this audio block of the input is silence (see ConvolutionEngine::process())
+	inline void process(const float* __restrict audioIn[2] , float* __restrict audioOut[2], bool inputSilent)
 	{
 		if (m_skipThisStage)
 			return;
 
 		const uint8_t numChannels = m_numChannels;
+		const uint8_t numInputChannels = m_numInputChannels;
 		const uint32_t blockSize = m_blockSize;
 		const uint32_t audioProcessingBlockSize = m_audioProcessingBlockSize;
 		const uint32_t convProcessingPointSamples = m_convProcessingPointSamples;
 		uint32_t audioBufferPtr = m_audioBufferPtr;
 		uint8_t audioReadWriteBufferIndex = m_audioReadWriteBufferIndex;
-		float* audioInputBuffer[2] = { nullptr, nullptr };
 		float* audioOutputBuffer[2] = { nullptr, nullptr };
 
+		for (uint32_t ch=0; ch<numInputChannels; ch++)
+			std::memcpy(&m_audioInputBuffer[audioReadWriteBufferIndex][ch][audioBufferPtr], audioIn[ch], audioProcessingBlockSize*sizeof(float));
+
+		m_audioInputSilent[audioReadWriteBufferIndex] = ((audioBufferPtr == 0) || m_audioInputSilent[audioReadWriteBufferIndex]) && inputSilent;
+
 		for (uint32_t ch=0; ch<numChannels; ch++)
 		{
-			audioInputBuffer[ch] = &m_audioInputBuffer[audioReadWriteBufferIndex][ch][audioBufferPtr];
 			audioOutputBuffer[ch] = &m_audioOutputBuffer[audioReadWriteBufferIndex][ch][audioBufferPtr];
 
-			for (int i=0; i<audioProcessingBlockSize; i++)
+			if (!m_replacesDirectStage)
 			{
-				audioInputBuffer[ch][i] = audioIn[ch][i];
-
-				if (!m_replacesDirectStage)
+				for (int i=0; i<audioProcessingBlockSize; i++)
 					audioOut[ch][i] += audioOutputBuffer[ch][i];
 			}
 		}
@@ -203,9 +327,36 @@ public:
 		if (audioBufferPtr == convProcessingPointSamples)
 		{
 			if (m_processInThread)
+			{
+				// the previous job's output buffer is read from the next audio block on (after the flip), and it's also the one the next job uses:
+				if (m_jobsDone.load(std::memory_order_acquire) != m_jobsSubmitted)
+					finishLateJob();
+
+				m_audioProcessBufferIndex = audioReadWriteBufferIndex;
+				m_jobsSubmitted++;
+
+				if (updateSilentBlockCount()) // nothing to convolve: no job needed
+					convolutionProcessOnSignal();
+				else
+					m_threadPool->submit(m_job, m_jobDeadlineNs);
+			}
+			else if (m_timeSliced)
+			{
+				DEBUG_ASSERT(m_sliceIndex == m_sliceCount); // the last slice of the previous one was on the previous call
+
+				m_audioProcessBufferIndex = audioReadWriteBufferIndex;
+
+				if (updateSilentBlockCount()) // nothing to convolve: no slices needed
+					convolutionProcessOnSignal();
+				else
+					m_sliceIndex = 0;
+			}
+			else if (m_spreadOverCalls) // kProcessingMode_OfflineSingleThread: where the job would run, so that the modes can be switched (see setProcessingMode())
 			{
 				m_audioProcessBufferIndex = audioReadWriteBufferIndex;
-				m_thread.notify();
+
+				updateSilentBlockCount();
+				convolutionProcessOnSignal();
 			}
 			else
 			{
@@ -213,10 +364,14 @@ public:
 					? (audioReadWriteBufferIndex == 0) ? 1 : 0
 					: audioReadWriteBufferIndex;
 
+				updateSilentBlockCount();
 				convolutionProcessOnSignal();
 			}
 		}
 
+		if (m_sliceIndex < m_sliceCount) // one slice on every call, starting on the processing point
+			processSlice();
+
 		if (audioBufferPtr >= blockSize)
 		{
 			DEBUG_ASSERT(audioBufferPtr == blockSize);
@@ -239,6 +394,28 @@ public:
 		m_audioBufferPtr = audioBufferPtr;
 	}
 
+	// kProcessingMode_Offline: called after process(), once all the stages have submitted their jobs. Finishes the job submitted in that call (if any)
+	inline void joinJob(void)
+	{
+		if (m_joinJob && (m_jobsDone.load(std::memory_order_acquire) != m_jobsSubmitted))
+			finishJob();
+	}
+
+	static constexpr uint32_t getBlockSize(void)
+	{
+		return m_blockSize;
+	}
+
+	inline uint32_t getDeadlineMissCount(void) const
+	{
+		return m_deadlineMissCount;
+	}
+
+	inline uint32_t getDeadlineMissRunInlineCount(void) const
+	{
+		return m_deadlineMissRunInlineCount;
+	}
+
 	inline bool canUpdateIr(void)
 	{
 		if (m_skipThisStage)
@@ -249,35 +426,154 @@ public:
 
 	inline void updateIr(uint8_t irIndex)
 	{
-		m_irIndex = irIndex;
+		if (irIndex < m_irBufferCount)
+			m_irIndex = irIndex;
+	}
 
-#	  if !ALWAYS_UPDATE_IR_BLOCKS
-		m_mustUpdateIrBlocks = true;
-#	  endif
+	// same timing requirements as updateIr(): gains are written to the buffer not in use, then switched
+	inline void updateDecayGains(uint32_t decayCutPointSamples, float decayEnvSmoothingFactor)
+	{
+		if (m_skipThisStage)
+			return;
+
+		const uint8_t gainsIndex = (m_irBlockGainsIndex == 0) ? 1 : 0;
+		const uint32_t blockOffset = m_replacesDirectStage ? 0 : 2;
+
+		for (uint32_t b=0; b<m_blockCount; b++)
+			m_irBlockGains[gainsIndex][b] = DspUtils::getDecayEnvelopeMean((b + blockOffset) * m_blockSize, m_blockSize, decayCutPointSamples, decayEnvSmoothingFactor);
+
+		// the last blocks, once the envelope is below BCNRVRB_TAIL_FLOOR_DB, are not convolved (at least one block is):
+		const float floorLin = DspUtils::dB2Lin(BCNRVRB_TAIL_FLOOR_DB, BCNRVRB_MIN_DB);
+		uint32_t activeBlockCount = m_blockCount;
+
+		while ((activeBlockCount > 1) && (m_irBlockGains[gainsIndex][activeBlockCount - 1] < floorLin))
+			activeBlockCount--;
+
+		m_irBlockGainsActiveCount[gainsIndex] = activeBlockCount;
+		m_irBlockGainsIndex = gainsIndex;
+	}
+
+	// the IR buffer irIndex is only audible up to irActiveLen samples (the decay envelope has faded it out): the blocks after it are not convolved
+	// (at least one block is), nor recomputed by updateIrBlocks(). To be called from the IR updater before that buffer is rewritten (never while
+	// it is in use), so a longer active part is always recomputed and ready when the buffer is switched to
+	inline void updateIrActiveLen(uint8_t irIndex, uint32_t irActiveLen)
+	{
+		if (m_skipThisStage || (irIndex >= m_irBufferCount))
+			return;
+
+		const uint32_t blockOffset = m_replacesDirectStage ? 0 : 2;
+		const uint32_t irActiveBlocks = (irActiveLen + m_blockSize - 1) / m_blockSize; // from the IR start
+
+		m_irActiveBlockCount[irIndex] = juce::jlimit(uint32_t(1), m_blockCount, (irActiveBlocks > blockOffset) ? irActiveBlocks - blockOffset : 1);
+	}
+
+	// called from the IR updater once the time-domain IR buffer irIndex has been rewritten from firstSample onwards (never while that buffer is in use)
+	inline void updateIrBlocks(uint8_t irIndex, uint32_t firstSample)
+	{
+		if (m_skipThisStage || (irIndex >= m_irBufferCount))
+			return;
+
+		const uint8_t numIrChannels = m_numIrChannels;
+		const uint32_t blockCount = m_irActiveBlockCount[irIndex];
+		const uint32_t firstBlock = getFirstChangedIrBlock(irIndex, firstSample);
+
+		for (uint32_t ch=0; ch<numIrChannels; ch++)
+		{
+			for (uint32_t b=firstBlock; b<blockCount; b++)
+				computeIrBlock(irIndex, ch, b);
+		}
+	}
+
+	// number of blocks updateIrBlocks() recomputes, to do them one at a time instead (see updateIrBlock())
+	inline uint32_t getIrBlockUpdateCount(uint8_t irIndex, uint32_t firstSample)
+	{
+		if (m_skipThisStage || (irIndex >= m_irBufferCount))
+			return 0;
+
+		return m_numIrChannels * (m_irActiveBlockCount[irIndex] - getFirstChangedIrBlock(irIndex, firstSample));
+	}
+
+	// the index-th block recomputed by updateIrBlocks() (index < getIrBlockUpdateCount()), same timing requirements
+	inline void updateIrBlock(uint8_t irIndex, uint32_t firstSample, uint32_t index)
+	{
+		const uint32_t firstBlock = getFirstChangedIrBlock(irIndex, firstSample);
+		const uint32_t blocksPerChannel = m_irActiveBlockCount[irIndex] - firstBlock;
+
+		computeIrBlock(irIndex, index / blocksPerChannel, firstBlock + index % blocksPerChannel);
 	}
 
 private:
+	static constexpr bool isSkipped(uint32_t audioProcessingBlockSize)
+	{
+		return m_replacesDirectStage
+			? (audioProcessingBlockSize != m_blockSize)
+			: (audioProcessingBlockSize > m_blockSize);
+	}
+
+	static constexpr uint32_t getBlockCount(uint32_t longestStageBlockSize, uint32_t longestStageBlockCount)
+	{
+		return (!m_replacesDirectStage && (longestStageBlockSize == m_blockSize)) ? longestStageBlockCount : m_blockCountMax;
+	}
+
+	// cost of an FFT or IFFT, in spectral MACs: roughly log2(FFT size) / 2 with pffft (only used to balance the slices, see processSlice())
+	static constexpr uint32_t getFftSliceCost(void)
+	{
+		uint32_t log2 = 0;
+
+		for (uint32_t size=m_fftSizeTimeDomain; size>1; size>>=1)
+			log2++;
+
+		return log2 / 2;
+	}
+
+	// blocks ending before firstSample are unchanged. The ones after the active part aren't recomputed: the samples they hold now are after both
+	// decay cut points (see ConvolutionReverb::Wet::beginIrUpdate()), so whenever they become active again, they are within the changed ones
+	inline uint32_t getFirstChangedIrBlock(uint8_t irIndex, uint32_t firstSample) const
+	{
+		const uint32_t blockOffset = m_replacesDirectStage ? 0 : 2;
+		const uint32_t firstSampleBlock = firstSample / m_blockSize;
+
+		return (firstSampleBlock > blockOffset) ? juce::jmin(firstSampleBlock - blockOffset, m_irActiveBlockCount[irIndex]) : 0;
+	}
+
+	inline void computeIrBlock(uint8_t irIndex, uint32_t ch, uint32_t blockIndex)
+	{
+		memcpy(m_irBlock, m_ir[irIndex][ch][blockIndex], m_blockSize*sizeof(float)); // 1st half of array: IR data
+
+		m_fftIr.process(m_irBlock, getIrBlock(irIndex, ch, blockIndex));
+	}
+
+	inline cplx_f32* getIrBlock(uint8_t irIndex, uint32_t ch, uint32_t blockIndex)
+	{
+		return &m_IR_BLOCKS[((irIndex * m_numIrChannels + ch) * m_blockCount + blockIndex) * m_fftFreqDomainMultiDimBufSize];
+	}
+
+	inline cplx_f32* getAudioInBlock(uint32_t ch, uint32_t blockIndex)
+	{
+		return &m_AUDIO_IN_BLOCKS[(ch * m_blockCount + blockIndex) * m_fftFreqDomainMultiDimBufSize];
+	}
+
 	void convolutionInit(void)
 	{
 		m_audioInBlocksWritePtr = 0;
 
-		for (uint32_t i=0; i<m_blockSize; i++)
-			m_irBlock[m_blockSize + i] = 0.0f; // 2nd half of array: zero padded for FFT IN
+		// all zeros: the stage starts idle
+		m_silentBlockCount = m_blockCount + 1;
 
-		for (uint32_t ch=0; ch<2; ch++)
+		for (uint32_t b=0; b<m_numBuffers; b++)
 		{
-			for (uint32_t b=0; b<m_blockCount; b++)
-				std::memset(m_AUDIO_IN_BLOCKS[ch][b], 0, m_fftFreqDomainMultiDimBufSize*sizeof(cplx_f32));
-			
-			std::memset(m_overlap[ch], 0, m_blockSize*sizeof(float));
+			m_audioInputSilent[b] = true;
+			m_audioOutputSilent[b] = true;
 		}
 
+		for (uint32_t ch=0; ch<m_numInputChannels; ch++)
+			std::memset(getAudioInBlock(ch, 0), 0, m_blockCount*m_fftFreqDomainMultiDimBufSize*sizeof(cplx_f32));
+
+		for (uint32_t ch=0; ch<m_numChannels; ch++)
+			std::memset(m_overlap[ch], 0, m_blockSize*sizeof(float));
+
 		m_fft.init(m_fftSizeTimeDomain, m_dataFftWork);
 		m_ifft.init(m_fftSizeTimeDomain, m_dataFftWork);
-
-#	  if !ALWAYS_UPDATE_IR_BLOCKS
-		m_mustUpdateIrBlocks = true;
-#	  endif
 	}
 
 	void convolutionExit(void)
@@ -286,95 +582,265 @@ private:
 		m_ifft.exit();
 	}
 
+	// the flags and the processing point for processingMode (see init() and setProcessingMode())
+	inline void initProcessingMode(ProcessingMode processingMode)
+	{
+		m_timeSliced = m_spreadOverCalls && (processingMode == kProcessingMode_RealtimeTimeSliced);
+
+#	  if CONVOLUTION_FFT_STAGE_USES_THREAD
+		m_processInThread = m_spreadOverCalls && (processingMode != kProcessingMode_OfflineSingleThread) && !m_timeSliced;
+#	  else
+		m_processInThread = false;
+#	  endif
+
+		m_joinJob = m_processInThread && (processingMode == kProcessingMode_Offline);
+
+		m_sliceCount = m_timeSliced ? m_blockSize / m_audioProcessingBlockSize : 0;
+		m_sliceIndex = m_sliceCount;
+
+		m_convProcessingPointSamples = (m_spreadOverCalls || (m_blockSize <= m_audioProcessingBlockSize)) ? m_blockSize : m_blockSize / 2;
+
+		m_jobDeadlineNs = m_joinJob
+			? 0 // needed by the end of this process() call
+			: static_cast<int64_t>(((m_blockSize - m_convProcessingPointSamples) + m_blockSize) * 1.0e9 / m_samplerate);
+	}
+
+	// the worker is late: the job is finished on the audio thread, so that the output is never stale or half-written
+	inline void finishLateJob(void)
+	{
+		m_deadlineMissCount.fetch_add(1, std::memory_order_relaxed);
+
+		if (finishJob())
+			m_deadlineMissRunInlineCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// runs the submitted job on the calling thread if no worker has taken it yet (returns true), otherwise waits for the worker to finish it
+	inline bool finishJob(void)
+	{
+		if (m_threadPool->runIfQueued(m_job))
+			return true;
+
+		while (m_jobsDone.load(std::memory_order_acquire) != m_jobsSubmitted) // a worker is running it
+			juce::Thread::yield();
+
+		return false;
+	}
+
+	// audio thread, at the processing point (once m_audioProcessBufferIndex is set, and the previous block processing is finished). Returns true
+	// if the input delay line is all silence, so the block processing is almost free (see convolutionIdle())
+	inline bool updateSilentBlockCount(void)
+	{
+		if (!m_audioInputSilent[m_audioProcessBufferIndex])
+			m_silentBlockCount = 0;
+		else if (m_silentBlockCount <= m_blockCount)
+			m_silentBlockCount++;
+
+		return m_silentBlockCount >= m_blockCount;
+	}
+
 	inline void convolutionProcessOnSignal(void)
 	{
-#	  if !ALWAYS_UPDATE_IR_BLOCKS
-		if (m_mustUpdateIrBlocks)
+		const uint8_t numChannels = m_numChannels;
+		const uint8_t numInputChannels = m_numInputChannels;
+
+		if (m_silentBlockCount >= m_blockCount)
+		{
+			convolutionIdle();
+			convolutionEnd();
+			return;
+		}
+
+		convolutionBegin();
+
+		const uint32_t macCount = getMacCountPerOutput();
+
+		// every input channel is transformed once (with a true-stereo IR or a mono input, its spectra are used by both output channels):
+		for (uint32_t ch=0; ch<numInputChannels; ch++)
+			convolutionInputFft(ch);
+
+		for (uint32_t outCh=0; outCh<numChannels; outCh++)
 		{
-			m_mustUpdateIrBlocks = false;
+			for (uint32_t mac=0; mac<macCount; mac++)
+				convolutionMac(outCh, mac);
 
-			convolutionUpdateIrBlocks();
+			convolutionOutput(outCh);
 		}
-#	  endif
 
-		const uint8_t numChannels = m_numChannels;
-		const uint32_t blockCount = m_blockCount;
-		const uint32_t blockSize = m_blockSize;
-		const uint8_t audioProcessBufferIndex = m_audioProcessBufferIndex;
-		const int audioInBlocksWritePtr = static_cast<int>(m_audioInBlocksWritePtr);
+		convolutionEnd();
+	}
 
-		for (uint32_t ch=0; ch<numChannels; ch++)
+	// kProcessingMode_RealtimeTimeSliced: the block processing is split into work units (see getSliceUnitCount()), run in order over m_sliceCount calls.
+	// Every slice gets the units whose cost midpoint falls within its share of the total cost, so each call does about the same amount of work
+	inline void processSlice(void)
+	{
+		const uint32_t sliceIndex = m_sliceIndex++;
+		const bool lastSlice = (m_sliceIndex == m_sliceCount);
+
+		if (sliceIndex == 0)
 		{
-			const float* in = m_audioInputBuffer[audioProcessBufferIndex][ch];
-			float* out = m_audioOutputBuffer[audioProcessBufferIndex][ch];
+			convolutionBegin();
 
-			m_fft.process((float *) in, m_AUDIO_IN_BLOCKS[ch][audioInBlocksWritePtr]);
+			m_sliceUnit = 0;
+			m_sliceCostDone = 0;
+			m_sliceCostTotal = (m_numInputChannels + m_numChannels) * getFftSliceCost() + m_numChannels * getMacCountPerOutput();
+		}
 
-			std::memset(m_CONV, 0, sizeof(m_CONV));
+		const uint32_t unitCount = getSliceUnitCount(); // once the block processing has begun (see getMacCountPerOutput())
 
-			for (uint32_t b=0; b<blockCount; b++)
-			{
-				int audioInBlocksReadPtr = int(audioInBlocksWritePtr) - int(b);
-				if (audioInBlocksReadPtr < 0)
-					audioInBlocksReadPtr += blockCount;
-
-#			  if ALWAYS_UPDATE_IR_BLOCKS
-				convolutionProcessIrBlock(ch, b);
-
-				//m_CONV += m_IR_BLOCK*m_AUDIO_IN_BLOCKS[audioInBlocksReadPtr];
-				m_ifft.convolve_accum(m_CONV, m_IR_BLOCK, m_AUDIO_IN_BLOCKS[ch][audioInBlocksReadPtr]);
-#			  else
-				//m_CONV += m_IR_BLOCKS[ch][b]*m_AUDIO_IN_BLOCKS[ch][audioInBlocksReadPtr];
-				m_ifft.convolve_accum(m_CONV, m_IR_BLOCKS[ch][b], m_AUDIO_IN_BLOCKS[ch][audioInBlocksReadPtr]);
-#			  endif
-			}
+		const uint32_t sliceCostEnd = uint32_t((uint64_t(m_sliceCostTotal) * (sliceIndex + 1)) / m_sliceCount);
 
-			m_ifft.process(m_conv, m_CONV);
+		while (m_sliceUnit < unitCount)
+		{
+			const uint32_t unitCost = getSliceUnitCost(m_sliceUnit);
+
+			if (!lastSlice && (m_sliceCostDone + unitCost / 2 >= sliceCostEnd))
+				break;
 
-			for (uint32_t i=0; i<blockSize; i++)
-				out[i] = m_conv[i] + m_overlap[ch][i]; // 1st half of convolution result is overlapped with 2nd half of previous
-		
-			// 2nd half of convolution result is saved to be overlapped with next buffer:
-			memcpy(m_overlap[ch], &m_conv[blockSize], blockSize*sizeof(float));
+			convolutionProcessUnit(m_sliceUnit++);
+			m_sliceCostDone += unitCost;
 		}
 
-		if (++m_audioInBlocksWritePtr >= blockCount)
+		if (lastSlice)
+			convolutionEnd();
+	}
+
+	// for the current block processing (once convolutionBegin() has latched its block count)
+	inline uint32_t getMacCountPerOutput(void) const
+	{
+		return (m_numIrChannels == 4) ? 2 * m_convBlockCount : m_convBlockCount; // true stereo: both input channels feed every output channel
+	}
+
+	// work units of a block processing, in order: the FFT of every input channel, then for every output channel, its MACs and its IFFT (with overlap-add)
+	inline uint32_t getSliceUnitCount(void) const
+	{
+		return m_numInputChannels + m_numChannels * (getMacCountPerOutput() + 1);
+	}
+
+	inline uint32_t getSliceUnitCost(uint32_t unit) const
+	{
+		const uint32_t numInputChannels = m_numInputChannels;
+		const uint32_t macCount = getMacCountPerOutput();
+
+		if (unit < numInputChannels)
+			return getFftSliceCost();
+
+		return (((unit - numInputChannels) % (macCount + 1)) == macCount) ? getFftSliceCost() : 1;
+	}
+
+	inline void convolutionProcessUnit(uint32_t unit)
+	{
+		const uint32_t numInputChannels = m_numInputChannels;
+		const uint32_t macCount = getMacCountPerOutput();
+
+		if (unit < numInputChannels)
 		{
-			DEBUG_ASSERT(m_audioInBlocksWritePtr == blockCount);
-			m_audioInBlocksWritePtr = 0;
+			convolutionInputFft(unit);
+			return;
 		}
+
+		const uint32_t outCh = (unit - numInputChannels) / (macCount + 1);
+		const uint32_t mac = (unit - numInputChannels) % (macCount + 1);
+
+		if (mac < macCount)
+			convolutionMac(outCh, mac);
+		else
+			convolutionOutput(outCh);
 	}
 
-# if ALWAYS_UPDATE_IR_BLOCKS
-	inline void convolutionProcessIrBlock(uint32_t ch, uint32_t blockIndex)
+	// the IR buffer and decay gains can only change between block processings (see canUpdateIr()), but a time-sliced one spans several calls
+	inline void convolutionBegin(void)
 	{
-		const float* ir = m_ir[m_irIndex][ch][blockIndex];
+		const uint8_t irIndex = m_irIndex;
+		const uint8_t gainsIndex = m_irBlockGainsIndex;
 
-		memcpy(m_irBlock, ir, m_blockSize*sizeof(float));
+		m_convIrIndex = irIndex;
+		m_convIrBlockGains = m_irBlockGains[gainsIndex];
+		m_convBlockCount = juce::jmin(m_irActiveBlockCount[irIndex], m_irBlockGainsActiveCount[gainsIndex]);
+	}
 
-		m_fft.process(m_irBlock, m_IR_BLOCK);
+	inline void convolutionInputFft(uint32_t ch)
+	{
+		if (m_silentBlockCount > 0) // treated as exact zeros, so that the delay line can become all zeros
+			std::memset(getAudioInBlock(ch, m_audioInBlocksWritePtr), 0, m_fftFreqDomainMultiDimBufSize*sizeof(cplx_f32));
+		else
+			m_fft.process(m_audioInputBuffer[m_audioProcessBufferIndex][ch], getAudioInBlock(ch, m_audioInBlocksWritePtr));
 	}
-# else
-	inline void convolutionUpdateIrBlocks(void)
+
+	// mac: 0 ... getMacCountPerOutput() - 1, in input channel, then IR block order. The first one clears the accumulator
+	inline void convolutionMac(uint32_t outCh, uint32_t mac)
+	{
+		const bool trueStereo = (m_numIrChannels == 4);
+		const uint32_t convBlockCount = m_convBlockCount;
+		const uint32_t inCh = trueStereo ? mac / convBlockCount : outCh;
+		const uint32_t irCh = trueStereo ? BCNRVRB_TRUE_STEREO_IR_CHANNEL(inCh, outCh) : outCh;
+		const uint32_t inBlocksCh = (m_numInputChannels == 1) ? 0 : inCh; // a mono input has a single set of input spectra
+		const uint32_t b = mac % convBlockCount;
+
+		if (mac == 0)
+			std::memset(m_CONV, 0, m_fftSizeFreqDomain*sizeof(cplx_f32));
+
+		int audioInBlocksReadPtr = int(m_audioInBlocksWritePtr) - int(b);
+		if (audioInBlocksReadPtr < 0)
+			audioInBlocksReadPtr += m_blockCount; // the whole delay line (only the first convBlockCount blocks are convolved)
+
+		//m_CONV += m_IR_BLOCKS[irIndex][irCh][b]*m_AUDIO_IN_BLOCKS[inBlocksCh][audioInBlocksReadPtr]*irBlockGains[b];
+		m_ifft.convolve_accum(m_CONV, getIrBlock(m_convIrIndex, irCh, b), getAudioInBlock(inBlocksCh, audioInBlocksReadPtr), m_convIrBlockGains[b]);
+	}
+
+	inline void convolutionOutput(uint32_t outCh)
 	{
-		const uint8_t numChannels = m_numChannels;
-		const uint32_t blockCount = m_blockCount;
 		const uint32_t blockSize = m_blockSize;
-		float* ir[2] = { m_ir[m_irIndex][0], m_ir[m_irIndex][1] };
+		float* out = m_audioOutputBuffer[m_audioProcessBufferIndex][outCh];
 
-		for (uint32_t ch=0; ch<numChannels; ch++)
+		m_ifft.process(m_conv, m_CONV);
+
+		for (uint32_t i=0; i<blockSize; i++)
+			out[i] = m_conv[i] + m_overlap[outCh][i]; // 1st half of convolution result is overlapped with 2nd half of previous
+
+		// 2nd half of convolution result is saved to be overlapped with next buffer:
+		memcpy(m_overlap[outCh], &m_conv[blockSize], blockSize*sizeof(float));
+
+		m_audioOutputSilent[m_audioProcessBufferIndex] = false;
+	}
+
+	// the whole input delay line is silent (m_silentBlockCount >= m_blockCount), so the convolution result is zero: no FFT, MAC or IFFT. The first
+	// time, the output is the previous block's overlap, and the oldest input block is cleared. From then on, the output is silence
+	inline void convolutionIdle(void)
+	{
+		const uint8_t processBufferIndex = m_audioProcessBufferIndex;
+
+		if (m_silentBlockCount == m_blockCount)
 		{
-			for (uint32_t b=0; b<blockCount; b++)
+			for (uint32_t ch=0; ch<m_numInputChannels; ch++)
+				std::memset(getAudioInBlock(ch, m_audioInBlocksWritePtr), 0, m_fftFreqDomainMultiDimBufSize*sizeof(cplx_f32));
+
+			for (uint32_t ch=0; ch<m_numChannels; ch++)
 			{
-				const float* irBlock = ir[ch][b];
+				std::memcpy(m_audioOutputBuffer[processBufferIndex][ch], m_overlap[ch], m_blockSize*sizeof(float));
+				std::memset(m_overlap[ch], 0, m_blockSize*sizeof(float));
+			}
 
-				memcpy(m_irBlock, irBlock, blockSize*sizeof(float)); // 1st half of array: IR data
+			m_audioOutputSilent[processBufferIndex] = false;
+		}
+		else if (!m_audioOutputSilent[processBufferIndex])
+		{
+			for (uint32_t ch=0; ch<m_numChannels; ch++)
+				std::memset(m_audioOutputBuffer[processBufferIndex][ch], 0, m_blockSize*sizeof(float));
 
-				m_fft.process(m_irBlock, m_IR_BLOCKS[ch][b]);
-			}
+			m_audioOutputSilent[processBufferIndex] = true;
 		}
 	}
-# endif
+
+	inline void convolutionEnd(void)
+	{
+		if (++m_audioInBlocksWritePtr >= m_blockCount)
+		{
+			DEBUG_ASSERT(m_audioInBlocksWritePtr == m_blockCount);
+			m_audioInBlocksWritePtr = 0;
+		}
+
+		m_jobsDone.fetch_add(1, std::memory_order_release);
+	}
 };
 
 ///////////////////////////////////////////////////////////////////////////////
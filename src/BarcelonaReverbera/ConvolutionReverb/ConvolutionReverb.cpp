@@ -18,7 +18,12 @@
 
 ///////////////////////////////////////////////////////////////////////////////
 
-ConvolutionReverb::ConvolutionReverb(void) : m_thread(juce::String("IrUpdater"), [this] () { }, [this] () { }, [this] () { updateIr(); }) {}
+ConvolutionReverb::ConvolutionReverb(void) : m_wet{ {*this}, {*this} }, m_irLoader(*this) {}
+
+ConvolutionReverb::~ConvolutionReverb(void)
+{
+	m_irLoader.stopThread(-1); // it uses both wet paths
+}
 
 void ConvolutionReverb::init(void)
 {
@@ -34,25 +39,25 @@ void ConvolutionReverb::init(void)
 		m_arrayDecayInterp[i] = BCNRVRB_DECAY_MIN + getLogTen0to1FromLin0to1(valLin, BCNRVRB_DECAY_KNOB_DECADES) * (1.0f - BCNRVRB_DECAY_MIN);
 	}
 
-	for (int ch=0; ch<2; ch++)
-	{
-		m_filterLPF[ch].init(true);
-		m_filterHPF[ch].init(false);
-	}
+	for (uint8_t i=0; i<2; i++)
+		m_wet[i].init();
+
+	m_irLoaderState = kIrLoaderState_Idle;
+	m_irLoader.startThread(juce::Thread::Priority::low);
 }
 
 void ConvolutionReverb::exit(void)
 {
-	m_convolutionEngine.exit();
+	m_irLoader.stopThread(-1);
 
-	for (int ch=0; ch<2; ch++)
-	{
-		m_filterLPF[ch].exit();
-		m_filterHPF[ch].exit();
-	}
+	for (uint8_t i=0; i<2; i++)
+		m_wet[i].exit();
 
-	if (m_thread.isThreadRunning())
-		DEBUG_VERIFY(m_thread.stopThread(2000));
+	// prepare() is needed again (or the reverb is rebuilt from the next process()):
+	m_irIndex = -1;
+	m_wetMuted = true;
+	m_crossfadePos = m_crossfadeLen;
+	m_blocksConfigured = false;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -60,14 +65,17 @@ void ConvolutionReverb::exit(void)
 void ConvolutionReverb::process(const float* __restrict audioIn[2], float* __restrict audioOut[2], bool stereo, double samplerate, int blockSize, float decayControl, float colorControl, float dryWetControl, int irIndex)
 {
 	const uint32_t numChannels = stereo ? 2 : 1;
+	const uint32_t numInputChannels = (stereo && (audioIn[0] != audioIn[1])) ? 2 : 1;
 
 	DEBUG_ASSERT(irIndex < getIrCount());
-	DEBUG_ASSERT(blockSize >= BCNRVRB_MIN_BLOCK_SIZE);
-	DEBUG_ASSERT(blockSize <= BCNRVRB_MAX_BLOCK_SIZE);
+	DEBUG_ASSERT(blockSize >= 0);
 	DEBUG_ASSERT(samplerate <= BCNRVRB_MAX_SAMPLERATE);
 
+	if (blockSize <= 0)
+		return;
+
 	// check for unsupported conditions:
-	if ((blockSize < BCNRVRB_MIN_BLOCK_SIZE) || (blockSize > BCNRVRB_MAX_BLOCK_SIZE) || (!DspUtils::isPowOf2(blockSize)) || (samplerate > BCNRVRB_MAX_SAMPLERATE))
+	if (samplerate > BCNRVRB_MAX_SAMPLERATE)
 	{
 		for (uint32_t ch=0; ch<numChannels; ch++)
 			std::memcpy(audioOut[ch], audioIn[ch], blockSize*sizeof(float));
@@ -75,16 +83,105 @@ void ConvolutionReverb::process(const float* __restrict audioIn[2], float* __res
 		return;
 	}
 
+	// nothing is reconfigured here: a wet path for the new settings is built off the audio thread, and switched to once ready (see
+	// updateWetSwitch()). The internal block size and the latency are locked by prepare() (if not prepared, by the first block size):
 	const bool paramChanges =
-		((m_irIndex != irIndex) || (m_samplerate != samplerate) || (m_blockSize != blockSize) || (m_numChannels != numChannels));
+		((m_irIndex < 0) || (m_samplerate != samplerate) || (m_numChannels != numChannels) || (m_numInputChannels != numInputChannels) || (m_decayColorOnWetSignal != m_decayColorOnWetSignalRequested));
 	
 	m_irIndex = irIndex;
 	m_samplerate = samplerate;
-	m_blockSize = blockSize;
 	m_numChannels = numChannels;
+	m_numInputChannels = numInputChannels;
+	m_decayColorOnWetSignal = m_decayColorOnWetSignalRequested;
+
+	if (!m_blocksConfigured)
+		configureBlocks(blockSize);
 
 	if (paramChanges)
-		reconfigure();
+		configureSamplerate();
+
+	updateProcessingMode();
+	updateWetSwitch(decayControl, colorControl);
+	updateTailLength(decayControl);
+
+	const uint32_t internalBlockSize = m_blockSize;
+
+	if (m_latencySamples == 0) // the block is split into internal blocks, processed in place (see setFixedBlockSize())
+	{
+		DEBUG_ASSERT((blockSize % internalBlockSize) == 0);
+
+		uint32_t start = 0;
+
+		for (; start+internalBlockSize<=uint32_t(blockSize); start+=internalBlockSize)
+		{
+			const float* blockIn[2] = { audioIn[0] + start, audioIn[1] + start };
+			float* blockOut[2] = { audioOut[0] + start, audioOut[1] + start };
+
+			processBlock(blockIn, blockOut, decayControl, colorControl, dryWetControl);
+		}
+
+		for (uint32_t ch=0; ch<numChannels; ch++) // a partial block breaks the caller's promise (see setFixedBlockSize()): it is bypassed
+			std::memcpy(audioOut[ch] + start, audioIn[ch] + start, (uint32_t(blockSize) - start)*sizeof(float));
+
+		return;
+	}
+
+	// host samples go through the input FIFO, and the output is read from the previous internal block (m_latencySamples == internalBlockSize):
+	uint32_t reblockPos = m_reblockPos;
+
+	for (uint32_t start=0; start<uint32_t(blockSize); )
+	{
+		const uint32_t len = juce::jmin(uint32_t(blockSize) - start, internalBlockSize - reblockPos);
+
+		for (uint8_t ch=0; ch<numInputChannels; ch++)
+			std::memcpy(&m_reblockIn[ch][reblockPos], &audioIn[ch][start], len*sizeof(float));
+
+		for (uint8_t ch=0; ch<numChannels; ch++)
+			std::memcpy(&audioOut[ch][start], &m_reblockOut[ch][reblockPos], len*sizeof(float));
+
+		start += len;
+		reblockPos += len;
+
+		if (reblockPos == internalBlockSize)
+		{
+			const float* blockIn[2] = { m_reblockIn[0], m_reblockIn[numInputChannels - 1] };
+			float* blockOut[2] = { m_reblockOut[0], m_reblockOut[1] };
+
+			processBlock(blockIn, blockOut, decayControl, colorControl, dryWetControl);
+
+			reblockPos = 0;
+		}
+	}
+
+	m_reblockPos = reblockPos;
+}
+
+// largest power of 2 not above the expected block size, within the engine's limits. Re-blocked host blocks (see setFixedBlockSize()) use
+// small internal blocks, as the latency is one of them: more process() calls of the engine per host block, but the same latency for any host
+uint32_t ConvolutionReverb::getInternalBlockSize(int expectedBlockSize, bool fixedBlockSize)
+{
+	const uint32_t maxBlockSize = fixedBlockSize ? BCNRVRB_MAX_BLOCK_SIZE : BCNRVRB_REBLOCK_MAX_BLOCK_SIZE;
+	uint32_t blockSize = BCNRVRB_MIN_BLOCK_SIZE;
+
+	while ((blockSize < maxBlockSize) && (int(2*blockSize) <= expectedBlockSize))
+		blockSize *= 2;
+
+	return blockSize;
+}
+
+int ConvolutionReverb::getLatencySamples(int expectedBlockSize, bool fixedBlockSize)
+{
+	const uint32_t internalBlockSize = getInternalBlockSize(expectedBlockSize, fixedBlockSize);
+
+	return (fixedBlockSize && (expectedBlockSize > 0) && ((expectedBlockSize % internalBlockSize) == 0)) ? 0 : int(internalBlockSize);
+}
+
+// processes one internal block (m_blockSize samples)
+void ConvolutionReverb::processBlock(const float* __restrict audioIn[2], float* __restrict audioOut[2], float decayControl, float colorControl, float dryWetControl)
+{
+	const uint32_t numChannels = m_numChannels;
+	const uint32_t numInputChannels = m_numInputChannels;
+	const uint32_t blockSize = m_blockSize;
 
 	const float dryTarget = getVolumeFromControl((dryWetControl < 0.0f) ? 1.0f : (1.0f - dryWetControl));
 	const float wetTarget = getVolumeFromControl((dryWetControl > 0.0f) ? 1.0f : (1.0f + dryWetControl));
@@ -107,32 +204,56 @@ void ConvolutionReverb::process(const float* __restrict audioIn[2], float* __res
 			const uint32_t index = i * dryWetSamplesBetweenRecalculate + j;
 
 			for (uint8_t ch=0; ch<numChannels; ch++)
-			{
 				m_audioDry[ch][index] = audioIn[ch][index]*dry;
+
+			for (uint8_t ch=0; ch<numInputChannels; ch++)
 				m_audioReverbIn[ch][index] = audioIn[ch][index]*wet;
-			}
 
 			dry += dryInc;
 			wet += wetInc;
 		}
 	}
 
-	if (m_convolutionEngine.canUpdateIr() && !m_updatingIr) // will be true every BCNRVRB_LONGEST_STAGE_SIZE samples
+	const float* audioReverbIn[2] = { m_audioReverbIn[0], m_audioReverbIn[numInputChannels - 1] }; // a mono input is only given once to the engine
+
+	if (m_wetMuted)
+	{
+		for (uint8_t ch=0; ch<2; ch++)
+			std::memset(audioOut[ch], 0, blockSize*sizeof(float));
+	}
+	else
 	{
-		m_convolutionEngine.updateIr(m_irUpdateIndex);	
+		m_wet[m_wetIndex].process(audioReverbIn, audioOut, decayControl, colorControl);
+	}
 
-		m_irUpdateIndex = (m_irUpdateIndex == 0) ? 1 : 0;
+	if (m_crossfadePos < m_crossfadeLen) // IR switch: the previous wet path keeps processing the input until it is faded out
+	{
+		float* audioWetPrev[2] = { m_audioWetPrev[0], m_audioWetPrev[1] };
 
-		m_decayControl = decayControl;
-		m_colorControl = colorControl;
+		m_wet[1 - m_wetIndex].process(audioReverbIn, audioWetPrev, decayControl, colorControl);
 
-		m_updatingIr = true;
-		m_thread.notify();
-	}
+		// equal-power crossfade (the IRs are uncorrelated):
+		const float step = float(0.5 * M_PI) / float(m_crossfadeLen);
+		uint32_t crossfadePos = m_crossfadePos;
 
-	const float* audioReverbIn[2] = { m_audioReverbIn[0], m_audioReverbIn[1] };
+		for (uint32_t i=0; i<blockSize; i++)
+		{
+			const float x = float(crossfadePos) * step;
+			const float gainIn = std::sin(x);
+			const float gainOut = std::cos(x);
 
-	m_convolutionEngine.process(audioReverbIn, audioOut);
+			for (uint8_t ch=0; ch<numChannels; ch++)
+				audioOut[ch][i] = audioOut[ch][i]*gainIn + m_audioWetPrev[ch][i]*gainOut;
+
+			if (crossfadePos < m_crossfadeLen)
+				crossfadePos++;
+		}
+
+		m_crossfadePos = crossfadePos;
+
+		if (m_crossfadePos == m_crossfadeLen)
+			requestIrLoader(kIrLoaderState_Release, decayControl, colorControl); // the previous wet path is no longer used
+	}
 
 	for (uint32_t i=0; i<blockSize; i++)
 	{
@@ -146,165 +267,955 @@ void ConvolutionReverb::process(const float* __restrict audioIn[2], float* __res
 
 ///////////////////////////////////////////////////////////////////////////////
 
+void ConvolutionReverb::prepare(double samplerate, bool stereo, bool monoInput, int expectedBlockSize, int irIndex, float decayControl, float colorControl)
+{
+	DEBUG_ASSERT(irIndex < getIrCount());
+	DEBUG_ASSERT(samplerate <= BCNRVRB_MAX_SAMPLERATE);
+
+	if (samplerate > BCNRVRB_MAX_SAMPLERATE) // unsupported: process() bypasses the audio
+		return;
+
+	m_irIndex = irIndex;
+	m_samplerate = samplerate;
+	m_numChannels = stereo ? 2 : 1;
+	m_numInputChannels = (stereo && !monoInput) ? 2 : 1;
+	m_decayColorOnWetSignal = m_decayColorOnWetSignalRequested;
+	m_processingMode = m_processingModeRequested;
+
+	configureBlocks(expectedBlockSize);
+	configureSamplerate();
+
+	reconfigure();
+
+	m_wet[m_wetIndex].buildIr(decayControl, colorControl);
+	m_wetMuted = false;
+
+	updateTailLength(decayControl);
+}
+
+// synchronous: configures the playing wet path for the current settings (see prepare()), releasing the other one
 void ConvolutionReverb::reconfigure(void)
 {
-	if (m_thread.isThreadRunning())
-		DEBUG_VERIFY(m_thread.stopThread(2000));
+	// the wet path being loaded (if any) was prepared for the previous settings:
+	waitForIrLoader();
 
-# if JUCE_MAC
-#  if 0 // XXX does this work on Apple Silicon? Does not work on Intel...
-	m_thread.startRealtimeThread(juce::Thread::RealtimeOptions{}.withMaximumProcessingTimeMs(BCNRVRB_LONGEST_STAGE_SIZE*1000.0/m_samplerate));
-#  else
-	m_thread.startRealtimeThread(juce::Thread::RealtimeOptions{}.withPriority(8));
-#  endif
-# else
-	//m_thread.startRealtimeThread(juce::Thread::RealtimeOptions{}.withPriority(8)); // XXX not working on linux?
-	m_thread.startThread(juce::Thread::Priority::high);
-# endif
+	m_wet[1 - m_wetIndex].release();
+	m_crossfadePos = m_crossfadeLen;
+
+	m_wet[m_wetIndex].configure(getWetConfig());
+}
+
+// locked until the next prepare(): the host is only told about the latency when preparing
+void ConvolutionReverb::configureBlocks(int expectedBlockSize)
+{
+	m_blockSize = getInternalBlockSize(expectedBlockSize, m_fixedBlockSize);
+	m_latencySamples = getLatencySamples(expectedBlockSize, m_fixedBlockSize);
+	m_reblockPos = 0;
+
+	for (uint8_t ch=0; ch<2; ch++)
+		std::memset(m_reblockOut[ch], 0, m_blockSize*sizeof(float)); // the first internal block of output (if re-blocking)
 
 	m_dryWetRecalculateTimesPerBlock = m_blockSize / m_dryWetSamplesBetweenRecalculate;
+	m_blocksConfigured = true;
+}
+
+// the settings which don't need a new wet path (no allocations, so they are changed right away)
+void ConvolutionReverb::configureSamplerate(void)
+{
 	m_dryWetSmoothingFactor = DspUtils::getTimeConstantMs(BCNRVRB_DRYWET_SMOOTH_LEN_MS, float(m_samplerate/m_dryWetSamplesBetweenRecalculate));
-	m_colorAndDecaySmoothingFactor = DspUtils::getTimeConstantMs(BCNRVRB_DECAY_COLOR_SMOOTH_LEN_MS, float(m_samplerate/float(BCNRVRB_LONGEST_STAGE_SIZE)));
+
+	m_crossfadeLen = uint32_t(m_samplerate * BCNRVRB_IR_CROSSFADE_LEN_MS / 1000.0f);
+	m_crossfadePos = m_crossfadeLen; // a switch in progress is finished (the wet paths are switched for the new settings)
+}
+
+// the wet paths in use are switched to the requested processing mode in place (e.g. when the host starts or stops an offline bounce).
+// If one of them can't be (see Wet::canSetProcessingMode()), the mode is changed anyway: they are rebuilt for it (see updateWetSwitch())
+void ConvolutionReverb::updateProcessingMode(void)
+{
+	const ProcessingMode processingMode = m_processingModeRequested;
+
+	if (processingMode == m_processingMode)
+		return;
+
+	const bool offline = (processingMode == kProcessingMode_Offline) || (processingMode == kProcessingMode_OfflineSingleThread);
+
+	// a request running on the IR loader owns the next wet path: when going offline it is waited for (see updateWetSwitch()), otherwise the
+	// switch is retried on the next call
+	if ((m_irLoaderState == kIrLoaderState_Load) || (m_irLoaderState == kIrLoaderState_Release))
+	{
+		if (!offline)
+			return;
+
+		while ((m_irLoaderState == kIrLoaderState_Load) || (m_irLoaderState == kIrLoaderState_Release))
+			juce::Thread::yield();
+	}
+
+	bool canSetProcessingMode = true;
+
+	for (uint8_t i=0; i<2; i++)
+	{
+		if (!m_wet[i].canSetProcessingMode(processingMode))
+			canSetProcessingMode = false;
+	}
+
+	if (canSetProcessingMode)
+	{
+		for (uint8_t i=0; i<2; i++)
+		{
+			if (m_wet[i].getIrIndex() >= 0) // the playing one, and the previous (crossfading) or the loaded next one
+				m_wet[i].setProcessingMode(processingMode);
+		}
+	}
+
+	m_processingMode = processingMode;
+}
+
+ConvolutionReverb::WetConfig ConvolutionReverb::getWetConfig(void) const
+{
+	WetConfig config;
+	config.irIndex = m_irIndex;
+	config.samplerate = m_samplerate;
+	config.blockSize = m_blockSize;
+	config.numChannels = m_numChannels;
+	config.numInputChannels = m_numInputChannels;
+	config.processingMode = m_processingMode;
+	config.decayColorOnWetSignal = m_decayColorOnWetSignal;
+
+	return config;
+}
+
+// called on every process(): when the IR or the settings change, the next wet path is loaded with them (see runIrLoaderRequest()), and then
+// switched to. An IR change is crossfaded (see processBlock()); after a settings change, the playing wet path is muted until then. Only one
+// switch is done at a time: if they change again meanwhile, they are loaded next
+void ConvolutionReverb::updateWetSwitch(float decayControl, float colorControl)
+{
+	const WetConfig config = getWetConfig();
+
+	m_wetMuted = !m_wet[m_wetIndex].m_config.isCompatible(config);
+
+	if (m_crossfadePos < m_crossfadeLen)
+		return;
+
+	const bool offline = (m_processingMode == kProcessingMode_Offline) || (m_processingMode == kProcessingMode_OfflineSingleThread);
+
+	// offline: a request still running on the IR loader (made before switching to offline) is waited for, so that the output doesn't depend on its timing
+	while (offline && ((m_irLoaderState == kIrLoaderState_Load) || (m_irLoaderState == kIrLoaderState_Release)))
+		juce::Thread::yield();
+
+	const Wet& wetNext = m_wet[1 - m_wetIndex];
+	const uint8_t irLoaderState = m_irLoaderState;
+
+	// the next wet path is only accessed once loaded (until then, the IR loader owns it):
+	const bool wetNextReady = (irLoaderState == kIrLoaderState_Loaded) && (wetNext.m_config == config);
+
+	if (!wetNextReady && ((irLoaderState == kIrLoaderState_Idle) || (irLoaderState == kIrLoaderState_Loaded)))
+	{
+		if (!(m_wet[m_wetIndex].m_config == config))
+			requestIrLoader(kIrLoaderState_Load, decayControl, colorControl);
+		else if (irLoaderState == kIrLoaderState_Loaded) // changed back before the switch
+			requestIrLoader(kIrLoaderState_Release, decayControl, colorControl);
+	}
+
+	if ((m_irLoaderState == kIrLoaderState_Loaded) && (wetNext.m_config == config)) // offline modes: loaded right away
+	{
+		m_wetIndex = 1 - m_wetIndex;
+		m_irLoaderState = kIrLoaderState_Idle;
+
+		if (m_wetMuted) // nothing to crossfade from: the previous wet path is released right away
+		{
+			m_wetMuted = false;
+			requestIrLoader(kIrLoaderState_Release, decayControl, colorControl);
+		}
+		else
+		{
+			m_crossfadePos = 0;
+		}
+	}
+}
+
+// irLoaderState: kIrLoaderState_Load or kIrLoaderState_Release, for the wet path not playing. The IR loader must be idle (or loaded)
+void ConvolutionReverb::requestIrLoader(uint8_t irLoaderState, float decayControl, float colorControl)
+{
+	DEBUG_ASSERT((m_irLoaderState == kIrLoaderState_Idle) || (m_irLoaderState == kIrLoaderState_Loaded));
+
+	m_irLoaderWetIndex = 1 - m_wetIndex;
+	m_irLoaderConfig = getWetConfig();
+	m_irLoaderDecayControl = decayControl;
+	m_irLoaderColorControl = colorControl;
+
+	m_irLoaderState = irLoaderState;
+
+	const bool offline = (m_processingMode == kProcessingMode_Offline) || (m_processingMode == kProcessingMode_OfflineSingleThread);
+
+	if (offline) // no timing constraints: the output must not depend on when the IR loader runs
+		runIrLoaderRequest();
+	else
+		m_irLoader.notify();
+}
+
+// IR loader thread (or the calling thread, in offline modes)
+void ConvolutionReverb::runIrLoaderRequest(void)
+{
+	Wet& wet = m_wet[m_irLoaderWetIndex];
+
+	if (m_irLoaderState == kIrLoaderState_Load)
+	{
+		wet.configure(m_irLoaderConfig);
+		wet.buildIr(m_irLoaderDecayControl, m_irLoaderColorControl);
+
+		m_irLoaderState = kIrLoaderState_Loaded;
+	}
+	else if (m_irLoaderState == kIrLoaderState_Release)
+	{
+		wet.release();
+
+		m_irLoaderState = kIrLoaderState_Idle;
+	}
+}
+
+// waits for the current IR loader request to finish, and discards the wet path it loaded (if any)
+void ConvolutionReverb::waitForIrLoader(void)
+{
+	while ((m_irLoaderState == kIrLoaderState_Load) || (m_irLoaderState == kIrLoaderState_Release))
+		juce::Thread::yield();
+
+	m_irLoaderState = kIrLoaderState_Idle;
+}
+
+void ConvolutionReverb::getDeadlineMissCounts(uint32_t stageBlockSize, uint32_t& missCount, uint32_t& missRunInlineCount)
+{
+	missCount = 0;
+	missRunInlineCount = 0;
+
+	for (uint8_t i=0; i<2; i++)
+	{
+		uint32_t wetMissCount, wetMissRunInlineCount;
+		m_wet[i].m_convolutionEngine.getDeadlineMissCounts(stageBlockSize, wetMissCount, wetMissRunInlineCount);
+
+		missCount += wetMissCount;
+		missRunInlineCount += wetMissRunInlineCount;
+	}
+}
+
+// IR length at samplerate, and its buffer length (with BCNRVRB_IR_EXTRA_ZEROS). The noise floor after the IR decay is left out
+void ConvolutionReverb::getIrLen(int irIndex, double samplerate, uint32_t& irLen, uint32_t& irLenWithZeros)
+{
+	const double irSamplerate = IrStore::getIrSamplerate(irIndex);
+	const uint32_t irLenSource = IrStore::getIrAudibleLen(irIndex);
+
+	if (samplerate == irSamplerate)
+		irLen = irLenSource;
+	else
+		irLen = SamplerateConverter::getOutputLength(irSamplerate, samplerate, irLenSource, BCNRVRB_IR_MAX_LEN_SAMPLES);
+
+	if (irLen < BCNRVRB_IR_MIN_LEN_SAMPLES)
+		irLen = BCNRVRB_IR_MIN_LEN_SAMPLES;
+
+	if (irLen > BCNRVRB_IR_MAX_LEN_SAMPLES - BCNRVRB_IR_EXTRA_ZEROS)
+		irLen = BCNRVRB_IR_MAX_LEN_SAMPLES - BCNRVRB_IR_EXTRA_ZEROS;
+
+	irLenWithZeros = irLen + BCNRVRB_IR_EXTRA_ZEROS;
+}
+
+// true-stereo IRs (4 channels) are only used with stereo audio: mono audio uses their 1st channel (LL), as it does with stereo IRs
+uint8_t ConvolutionReverb::getIrChannelCount(int irIndex, uint8_t numChannels)
+{
+	return ((IrStore::getIrChannelCount(irIndex) == 4) && (numChannels == 2)) ? 4 : numChannels;
+}
+
+uint32_t ConvolutionReverb::getTailLengthSamples(int irIndex, double samplerate)
+{
+	uint32_t irLen, irLenWithZeros;
+	getIrLen(irIndex, samplerate, irLen, irLenWithZeros);
+
+	return irLen;
+}
+
+// the tail of the playing wet path, at the requested decay (the decay being smoothed towards it is not waited for)
+void ConvolutionReverb::updateTailLength(float decayControl)
+{
+	Wet& wet = m_wet[m_wetIndex];
+
+	if (wet.getIrIndex() < 0)
+		return;
+
+	const uint32_t tailLengthSamples = wet.getTailLengthSamples(getDecayFromDecayControl(decayControl)) + m_latencySamples;
+
+	m_tailLengthSeconds.store(float(double(tailLengthSamples) / m_samplerate), std::memory_order_relaxed);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+ConvolutionReverb::Wet::Wet(ConvolutionReverb& reverb) : m_reverb(reverb), m_irUpdateJob(DspJob::kLane_Long, [this] () { updateIr(true); }) {}
+
+ConvolutionReverb::Wet::~Wet(void)
+{
+	if (m_threadPool != nullptr)
+		m_threadPool->wait(m_irUpdateJob);
+}
+
+void ConvolutionReverb::Wet::init(void)
+{
+	for (int ch=0; ch<BCNRVRB_MAX_IR_CHANNELS; ch++)
+	{
+		m_filterLPF[ch].init(true);
+		m_filterHPF[ch].init(false);
+	}
+}
+
+void ConvolutionReverb::Wet::exit(void)
+{
+	if (m_threadPool != nullptr)
+		m_threadPool->wait(m_irUpdateJob); // the IR updater uses the engine
+
+	m_threadPool = nullptr;
+
+	m_convolutionEngine.exit();
+
+	for (int ch=0; ch<BCNRVRB_MAX_IR_CHANNELS; ch++)
+	{
+		m_filterLPF[ch].exit();
+		m_filterHPF[ch].exit();
+	}
+
+	// release the shared IR (the engine points to it):
+	m_preparedIr = nullptr;
+	m_config.irIndex = -1;
+}
+
+void ConvolutionReverb::Wet::configure(const WetConfig& config)
+{
+	m_config = config;
+
+	const bool decayColorOnWetSignal = m_config.decayColorOnWetSignal;
+
+	if (m_threadPool != nullptr)
+		m_threadPool->wait(m_irUpdateJob); // an IR update may still be running
+	else if ((m_config.processingMode == kProcessingMode_Realtime) || (m_config.processingMode == kProcessingMode_Offline)) // see setProcessingMode()
+		m_threadPool = DspThreadPool::acquire();
+
+	m_updatingIr = false;
+
+	m_colorAndDecaySmoothingFactor = DspUtils::getTimeConstantMs(BCNRVRB_DECAY_COLOR_SMOOTH_LEN_MS, float(m_config.samplerate/float(BCNRVRB_LONGEST_STAGE_SIZE)));
+	m_colorWetSmoothingFactor = DspUtils::getTimeConstantMs(BCNRVRB_DECAY_COLOR_SMOOTH_LEN_MS, float(m_config.samplerate/float(m_config.blockSize)));
+
+	m_convolutionEngine.exit();
+
+	// IR length at the current samplerate (known before resampling, so that all buffers can be sized first):
+	uint32_t irLenWithZeros = 0;
+	getIrLen(m_config.irIndex, m_config.samplerate, m_irLen, irLenWithZeros);
+
+	m_numIrChannels = getIrChannelCount(m_config.irIndex, m_config.numChannels);
+
+	DEBUG_ASSERT(irLenWithZeros <= BCNRVRB_IR_MAX_LEN_SAMPLES);
+
+	// all per-instance buffers are (re)allocated zeroed, in a single memory block:
+	m_arena.beginPlan();
+	allocateBuffers(irLenWithZeros);
+	m_arena.commit();
+	allocateBuffers(irLenWithZeros);
+
+	// the pre-processed IR is only prepared by the first instance using it with this configuration:
+	IrStore::Key irKey;
+	irKey.irIndex = m_config.irIndex;
+	irKey.samplerate = m_config.samplerate;
+	irKey.numChannels = m_config.numChannels;
+	if (decayColorOnWetSignal)
+		irKey.blockSize = m_config.blockSize; // the IR is static, so its freq. domain blocks are shared too
+
+	bool engineInitialized = false;
+
+	std::shared_ptr<const IrStore::PreparedIr> preparedIr = IrStore::acquire(irKey, [this, &irKey, irLenWithZeros, decayColorOnWetSignal, &engineInitialized] (IrStore::PreparedIr& newIr)
+	{
+		float* ir[BCNRVRB_MAX_IR_CHANNELS] = {};
+
+		newIr.irLen = m_irLen;
+		newIr.irLenWithZeros = irLenWithZeros;
+
+		newIr.arena.beginPlan();
+		allocateSharedBuffers(newIr.arena, ir, irLenWithZeros);
+
+		const bool cached = IrStore::loadCached(irKey, newIr); // prepared in an earlier session: memory-mapped, read-only
+
+		if (!cached)
+			newIr.arena.commit();
+		allocateSharedBuffers(newIr.arena, ir, irLenWithZeros);
+
+		if (!cached)
+			prepareIr(ir, irLenWithZeros);
+
+		for (uint8_t ch=0; ch<BCNRVRB_MAX_IR_CHANNELS; ch++)
+			newIr.ir[ch] = ir[ch];
+
+		if (decayColorOnWetSignal)
+		{
+			m_convolutionEngine.init(m_config.samplerate, m_config.blockSize, m_config.numChannels, m_config.numInputChannels, m_numIrChannels, newIr.ir, nullptr, m_irLen, irLenWithZeros, m_config.processingMode);
+
+			if (!cached)
+				m_convolutionEngine.updateIrBlocks(0); // the IR is static, its freq. domain blocks are computed only here
+
+			engineInitialized = true;
+		}
+
+		if (!cached)
+			IrStore::storeCached(irKey, newIr);
+	});
+
+	DEBUG_ASSERT((preparedIr->irLen == m_irLen) && (preparedIr->irLenWithZeros == irLenWithZeros));
+
+	m_preparedIr = preparedIr; // releases the previous one
+
+	if (decayColorOnWetSignal)
+	{
+		if (!engineInitialized)
+		{
+			// point the engine to the freq. domain blocks of the shared IR:
+			MemoryArena sharedArena;
+			float* ir[BCNRVRB_MAX_IR_CHANNELS] = {};
+
+			sharedArena.beginView(preparedIr->arena);
+			allocateSharedBuffers(sharedArena, ir, irLenWithZeros);
+
+			m_convolutionEngine.init(m_config.samplerate, m_config.blockSize, m_config.numChannels, m_config.numInputChannels, m_numIrChannels, preparedIr->ir, nullptr, m_irLen, irLenWithZeros, m_config.processingMode);
+		}
+
+		uint32_t decayCutPointSamples;
+		float decayEnvSmoothingFactor;
+
+		getDecayEnvelope(m_decayCurrent, decayCutPointSamples, decayEnvSmoothingFactor);
+
+		m_convolutionEngine.updateDecayGains(decayCutPointSamples, decayEnvSmoothingFactor);
+	}
+	else
+	{
+		const float* irPostProcessed0[BCNRVRB_MAX_IR_CHANNELS] = { m_irPostProcessed[0][0], m_irPostProcessed[0][1], m_irPostProcessed[0][2], m_irPostProcessed[0][3] };
+		const float* irPostProcessed1[BCNRVRB_MAX_IR_CHANNELS] = { m_irPostProcessed[1][0], m_irPostProcessed[1][1], m_irPostProcessed[1][2], m_irPostProcessed[1][3] };
+
+		m_convolutionEngine.init(m_config.samplerate, m_config.blockSize, m_config.numChannels, m_config.numInputChannels, m_numIrChannels, irPostProcessed0, irPostProcessed1, m_irLen, irLenWithZeros, m_config.processingMode);
+
+		// the engine starts on IR buffer 0, so the IR updater starts on buffer 1:
+		m_irUpdateIndex = 1;
+		m_irUpdatePending = false;
+		m_irRebuildRequired = true;
+
+		for (int i=0; i<2; i++)
+			m_irBufferParams[i].valid = false;
+	}
+
+	for (int ch=0; ch<BCNRVRB_MAX_IR_CHANNELS; ch++)
+	{
+		m_filterLPF[ch].reset();
+		m_filterHPF[ch].reset();
+	}
+}
+
+
+// frees the buffers and the shared IR of a wet path no longer used (the DSP thread pool is kept, for the next configure())
+void ConvolutionReverb::Wet::release(void)
+{
+	if (m_config.irIndex < 0)
+		return;
+
+	if (m_threadPool != nullptr)
+		m_threadPool->wait(m_irUpdateJob);
+
+	m_updatingIr = false;
 
 	m_convolutionEngine.exit();
 
-	float* irPreProcessed[2] = { m_irPreProcessed[0], m_irPreProcessed[1] };
-	float* irPostProcessed0[2] = { m_irPostProcessed[0][0], m_irPostProcessed[0][1] };
-	float* irPostProcessed1[2] = { m_irPostProcessed[1][0], m_irPostProcessed[1][1] };
+	m_preparedIr = nullptr;
+	m_arena.release();
+	m_config.irIndex = -1;
+}
+
+// builds the first IR of a configured wet path, on the decay and color targets, before it starts playing (so that it can be done off the audio thread)
+void ConvolutionReverb::Wet::buildIr(float decayControl, float colorControl)
+{
+	m_decayControl = decayControl;
+	m_colorControl = colorControl;
+
+	if (m_config.decayColorOnWetSignal)
+	{
+		m_decayCurrent = m_reverb.getDecayFromDecayControl(decayControl);
+
+		uint32_t decayCutPointSamples;
+		float decayEnvSmoothingFactor;
 
-	for (int ch=0; ch<2; ch++)
+		getDecayEnvelope(m_decayCurrent, decayCutPointSamples, decayEnvSmoothingFactor);
+
+		m_convolutionEngine.updateDecayGains(decayCutPointSamples, decayEnvSmoothingFactor);
+
+		float filterLpfCutoff, filterHpfCutoff;
+		m_reverb.getColorFilterCutoffs(colorControl, filterLpfCutoff, filterHpfCutoff);
+
+		for (uint8_t ch=0; ch<m_config.numChannels; ch++)
+		{
+			m_filterLPF[ch].setTargetFreq(filterLpfCutoff, 0.0f, m_config.samplerate);
+			m_filterHPF[ch].setTargetFreq(filterHpfCutoff, 0.0f, m_config.samplerate);
+		}
+	}
+	else
 	{
-		std::memset(irPreProcessed[ch], 0, BCNRVRB_IR_MAX_LEN_SAMPLES*sizeof(float));
-		std::memset(irPostProcessed0[ch], 0, BCNRVRB_IR_MAX_LEN_SAMPLES*sizeof(float));
-		std::memset(irPostProcessed1[ch], 0, BCNRVRB_IR_MAX_LEN_SAMPLES*sizeof(float));
+		updateIr(false);
+
+		m_convolutionEngine.updateIr(m_irUpdateIndex);
+		m_irUpdateIndex = (m_irUpdateIndex == 0) ? 1 : 0;
+		m_irRebuildRequired = false;
 	}
+}
+
+// audio thread: the DSP thread pool can't be acquired there, so the modes which use it need it acquired by configure() already
+bool ConvolutionReverb::Wet::canSetProcessingMode(ProcessingMode processingMode) const
+{
+	const bool usesThreadPool = (processingMode == kProcessingMode_Realtime) || (processingMode == kProcessingMode_Offline);
+
+	return (m_config.irIndex < 0) || !usesThreadPool || (m_threadPool != nullptr);
+}
+
+// switches a configured wet path to another processing mode in place (audio thread, between process() calls). An IR update in progress is
+// finished first, in the mode it was started in (it is switched to on the next IR update point, as usual)
+void ConvolutionReverb::Wet::setProcessingMode(ProcessingMode processingMode)
+{
+	DEBUG_ASSERT(canSetProcessingMode(processingMode));
+
+	if (m_updatingIr)
+	{
+		if (m_config.processingMode == kProcessingMode_RealtimeTimeSliced)
+		{
+			while (m_updatingIr)
+				continueIrUpdate();
+		}
+		else if (!m_threadPool->runIfQueued(m_irUpdateJob))
+		{
+			m_threadPool->wait(m_irUpdateJob);
+		}
+	}
+
+	m_convolutionEngine.setProcessingMode(processingMode, m_threadPool);
+	m_config.processingMode = processingMode;
+}
+
+// convolution of one internal block (already scaled by the wet gain) with this wet path's IR, and its decay and color processing
+void ConvolutionReverb::Wet::process(const float* __restrict audioIn[2], float* __restrict audioOut[2], float decayControl, float colorControl)
+{
+	if (m_config.decayColorOnWetSignal)
+	{
+		if (m_convolutionEngine.canUpdateIr() && (m_reverb.getDecayFromDecayControl(decayControl) != m_decayCurrent)) // will be true every BCNRVRB_LONGEST_STAGE_SIZE samples, while decay is moving
+		{
+			uint32_t decayCutPointSamples;
+			float decayEnvSmoothingFactor;
+
+			updateDecayCurrent(decayControl, m_colorAndDecaySmoothingFactor, decayCutPointSamples, decayEnvSmoothingFactor);
+
+			m_convolutionEngine.updateDecayGains(decayCutPointSamples, decayEnvSmoothingFactor);
+		}
+	}
+	else
+	{
+		// offline: the first IR is built and switched to right away, as nothing has been convolved with the (silent) initial IR buffer yet
+		const bool irUpdateInline = (m_config.processingMode == kProcessingMode_Offline) || (m_config.processingMode == kProcessingMode_OfflineSingleThread);
+		const bool irRebuildNow = irUpdateInline && m_irRebuildRequired;
+
+		if ((m_convolutionEngine.canUpdateIr() || irRebuildNow) && !m_updatingIr) // will be true every BCNRVRB_LONGEST_STAGE_SIZE samples
+		{
+			if (m_irUpdatePending) // the IR updater has finished with the inactive IR buffer: switch to it
+			{
+				m_convolutionEngine.updateIr(m_irUpdateIndex);
+
+				m_irUpdateIndex = (m_irUpdateIndex == 0) ? 1 : 0;
+				m_irUpdatePending = false;
+			}
+
+			if (irNeedsUpdate(decayControl, colorControl)) // once decay and color have converged, the IR updater stays idle
+			{
+				m_decayControl = decayControl;
+				m_colorControl = colorControl;
+
+				m_irRebuildRequired = false;
+
+				if (irUpdateInline) // the IR buffer is ready right away, so it is switched to now instead of on the next IR update point
+				{
+					updateIr(!irRebuildNow); // the first IR starts on the decay and color targets, with no smoothing from the previous values
+
+					m_convolutionEngine.updateIr(m_irUpdateIndex);
+					m_irUpdateIndex = (m_irUpdateIndex == 0) ? 1 : 0;
+				}
+				else if (m_config.processingMode == kProcessingMode_RealtimeTimeSliced) // continued on every call from now on (it can take longer than an IR update period)
+				{
+					m_irUpdatePending = true;
+					m_updatingIr = true;
+					beginIrUpdate(true);
+				}
+				else
+				{
+					m_irUpdatePending = true;
+					m_updatingIr = true;
+					m_threadPool->submit(m_irUpdateJob, static_cast<int64_t>(BCNRVRB_LONGEST_STAGE_SIZE * 1.0e9 / m_config.samplerate)); // due by the next IR update point
+				}
+			}
+		}
+
+		if ((m_config.processingMode == kProcessingMode_RealtimeTimeSliced) && m_updatingIr)
+			continueIrUpdate();
+	}
+
+	m_convolutionEngine.process(audioIn, audioOut);
+
+	if (m_config.decayColorOnWetSignal)
+	{ // color processing (the filters are LTI, so they can be applied to the wet signal instead of the IR):
+		const uint32_t numChannels = m_config.numChannels;
+		const uint32_t blockSize = m_config.blockSize;
+
+		float filterLpfCutoff, filterHpfCutoff;
+		m_reverb.getColorFilterCutoffs(colorControl, filterLpfCutoff, filterHpfCutoff);
+
+		for (uint8_t ch=0; ch<numChannels; ch++)
+		{
+			m_filterLPF[ch].setTargetFreq(filterLpfCutoff, m_colorWetSmoothingFactor, m_config.samplerate);
+			m_filterLPF[ch].process(audioOut[ch], audioOut[ch], blockSize);
+
+			m_filterHPF[ch].setTargetFreq(filterHpfCutoff, m_colorWetSmoothingFactor, m_config.samplerate);
+			m_filterHPF[ch].process(audioOut[ch], audioOut[ch], blockSize);
+		}
+	}
+}
+
+// called twice, with the arena in its planning and allocation passes (see MemoryArena)
+void ConvolutionReverb::Wet::allocateBuffers(uint32_t irBufferLen)
+{
+	const uint8_t numChannels = m_config.numChannels;
 
-	m_irLen = m_impulseResponses.getIrLen(m_irIndex);
-	uint32_t irLenWithZeros = m_impulseResponses.getIrLenWithZeros(m_irIndex);
-	const uint32_t numExtraZeros = irLenWithZeros - m_irLen;
+	m_convolutionEngine.allocateBuffers(m_arena, m_config.blockSize, numChannels, m_config.numInputChannels, m_irLen);
 
-	if (m_samplerate == BCNRVRB_DEFAULT_IR_SAMPLERATE)
+	if (m_config.decayColorOnWetSignal) // the IR is only in the shared buffers
+		return;
+
+	const uint8_t numIrChannels = m_numIrChannels;
+	const uint8_t irBufferCount = 2;
+
+	for (uint8_t i=0; i<irBufferCount; i++)
 	{
-		DEBUG_ASSERT(irLenWithZeros <= BCNRVRB_IR_MAX_LEN_SAMPLES);
+		for (uint8_t ch=0; ch<BCNRVRB_MAX_IR_CHANNELS; ch++)
+			m_irPostProcessed[i][ch] = (ch < numIrChannels) ? m_arena.allocate<float>(irBufferLen) : nullptr;
+	}
 
-		for (int ch=0; ch<2; ch++)
-			memcpy(irPreProcessed[ch], m_impulseResponses.getIrAudioBuffer(m_irIndex, ch), irLenWithZeros*sizeof(float));
+	m_irFilterCheckpointCount = irBufferLen / BCNRVRB_IR_CHECKPOINT_LEN + 1;
+	m_irFilterCheckpoints = m_arena.allocate<double>(irBufferCount * m_irFilterCheckpointCount * numIrChannels * 2 * FilterBiquad::kState_Count);
+
+	m_convolutionEngine.allocateIrBlocks(m_arena, m_config.blockSize, numIrChannels, irBufferCount, m_irLen); // rebuilt on every decay/color change, so private
+}
+
+// buffers of the shared IR (see IrStore). Same passes as allocateBuffers(), plus a view pass from the instances not building it
+void ConvolutionReverb::Wet::allocateSharedBuffers(MemoryArena& arena, float* ir[BCNRVRB_MAX_IR_CHANNELS], uint32_t irBufferLen)
+{
+	const uint8_t numIrChannels = m_numIrChannels;
+
+	for (uint8_t ch=0; ch<BCNRVRB_MAX_IR_CHANNELS; ch++)
+		ir[ch] = (ch < numIrChannels) ? arena.allocate<float>(irBufferLen) : nullptr;
+
+	if (m_config.decayColorOnWetSignal)
+		m_convolutionEngine.allocateIrBlocks(arena, m_config.blockSize, numIrChannels, 1, m_irLen);
+}
+
+// resamples (if needed) and normalizes the current IR into ir
+void ConvolutionReverb::Wet::prepareIr(float* ir[BCNRVRB_MAX_IR_CHANNELS], uint32_t irLenWithZeros)
+{
+	const int irIndex = m_config.irIndex;
+	const uint8_t numIrChannels = m_numIrChannels;
+	const double irSamplerate = IrStore::getIrSamplerate(irIndex);
+	const uint32_t irLenSource = IrStore::getIrLen(irIndex);
+
+	if ((m_config.samplerate == irSamplerate) && (irLenSource <= m_irLen))
+	{
+		// decoded (or copied) straight into the shared buffers, which are already zeroed after the IR (left silent if it can't be read):
+		DEBUG_VERIFY(IrStore::readIr(irIndex, ir, numIrChannels));
 	}
 	else
 	{
-		const float* irAudioIn[2] = { m_impulseResponses.getIrAudioBuffer(m_irIndex, 0), m_impulseResponses.getIrAudioBuffer(m_irIndex, 1) };
+		const int numChannelsSource = IrStore::getIrChannelCount(irIndex);
+		const float* irAudioIn[BCNRVRB_MAX_IR_CHANNELS] = {};
+		std::vector<float> irDecoded;
 
-		SamplerateConverter::convert(BCNRVRB_DEFAULT_IR_SAMPLERATE, m_samplerate, irAudioIn, irPreProcessed, m_impulseResponses.getIrLen(m_irIndex), BCNRVRB_IR_MAX_LEN_SAMPLES, m_irLen);
+		for (int ch=0; ch<numIrChannels; ch++)
+			irAudioIn[ch] = IrStore::getIrAudioBuffer(irIndex, ch % numChannelsSource);
 
-		if (m_irLen < BCNRVRB_IR_MIN_LEN_SAMPLES)
-			m_irLen = BCNRVRB_IR_MIN_LEN_SAMPLES;
+		if (irAudioIn[0] == nullptr) // not in memory: decoded first
+		{
+			float* irDecodedChannels[BCNRVRB_MAX_IR_CHANNELS] = {};
+
+			irDecoded.resize(size_t(irLenSource) * numIrChannels);
+
+			for (int ch=0; ch<numIrChannels; ch++)
+			{
+				irDecodedChannels[ch] = &irDecoded[size_t(irLenSource) * ch];
+				irAudioIn[ch] = irDecodedChannels[ch];
+			}
+
+			DEBUG_VERIFY(IrStore::readIr(irIndex, irDecodedChannels, numIrChannels));
+		}
 
-		irLenWithZeros = m_irLen + numExtraZeros;
+		uint32_t irLenResampled = 0;
 
-		if (irLenWithZeros > BCNRVRB_IR_MAX_LEN_SAMPLES)
-			irLenWithZeros = BCNRVRB_IR_MAX_LEN_SAMPLES;
+		SamplerateConverter::convert(irSamplerate, m_config.samplerate, numIrChannels, irAudioIn, ir, irLenSource, m_irLen, irLenResampled);
+		DEBUG_ASSERT(irLenResampled <= m_irLen);
+
+		if (SamplerateConverter::getOutputLength(irSamplerate, m_config.samplerate, irLenSource, UINT32_MAX) > m_irLen)
+		{
+			// the IR is cut at m_irLen (see getIrLen()), so it ends with a fade-out:
+			const uint32_t fadeLen = std::min(static_cast<uint32_t>(m_config.samplerate * BCNRVRB_IR_NOISE_FLOOR_FADE_MS / 1000.0), m_irLen);
+
+			for (int ch=0; ch<numIrChannels; ch++)
+			{
+				for (uint32_t i=0; i<fadeLen; i++)
+					ir[ch][m_irLen - fadeLen + i] *= float(fadeLen - i) / float(fadeLen + 1);
+			}
+		}
 	}
 
 	{ // IR normalization (post-size, pre-color): (what matters is the IR level and its length)
 		double sumSquares = 0.0f;
 
-		for (int ch=0; ch<m_numChannels; ch++)
+		for (int ch=0; ch<numIrChannels; ch++)
 		{
 			for (uint32_t i=0; i<m_irLen; i++)
 			{
-				const float sample = irPreProcessed[ch][i];
+				const float sample = ir[ch][i];
 				sumSquares += sample*sample;
 			}
 		}
 
-		sumSquares /= static_cast<double>(m_numChannels);
+		sumSquares /= static_cast<double>(m_config.numChannels); // per output channel (with a true-stereo IR, each one sums 2 IR channels)
 
 		if (sumSquares > 1e-7f)
 		{
 			const float normalizationFactor = 0.65f / std::sqrt(sumSquares); // set experimentally. JUCE uses 0.125f
 
-			for (int ch=0; ch<m_numChannels; ch++)
+			for (int ch=0; ch<numIrChannels; ch++)
 			{
 				for (uint32_t i=0; i<m_irLen; i++)
-					irPreProcessed[ch][i] *= normalizationFactor;
+					ir[ch][i] *= normalizationFactor;
 			}
 		}
 	}
+}
 
-	m_convolutionEngine.init(m_samplerate, m_blockSize, m_numChannels, irPostProcessed0, irPostProcessed1, m_irLen, irLenWithZeros);
+///////////////////////////////////////////////////////////////////////////////
 
-	for (int ch=0; ch<2; ch++)
-	{
-		m_filterLPF[ch].reset();
-		m_filterHPF[ch].reset();
-	}
+void ConvolutionReverb::Wet::updateDecayCurrent(float decayControl, float smoothingFactor, uint32_t& decayCutPointSamples, float& decayEnvSmoothingFactor)
+{
+	const float decayTarget = m_reverb.getDecayFromDecayControl(decayControl);
+
+	const float decayNext = DspUtils::expSmoothing(decayTarget, m_decayCurrent, smoothingFactor);
+
+	m_decayCurrent = (decayNext == m_decayCurrent)
+		? decayTarget // we have reached a point where diff between target and current is only due to FP precission
+		: decayNext;
+
+	getDecayEnvelope(m_decayCurrent, decayCutPointSamples, decayEnvSmoothingFactor);
+}
+
+uint32_t ConvolutionReverb::Wet::getTailLengthSamples(float decay)
+{
+	uint32_t decayCutPointSamples;
+	float decayEnvSmoothingFactor;
+	getDecayEnvelope(decay, decayCutPointSamples, decayEnvSmoothingFactor);
+
+	return getIrActiveLen(decayCutPointSamples, decayEnvSmoothingFactor);
+}
+
+// where the decay envelope falls below BCNRVRB_TAIL_FLOOR_DB (the IR itself is not measured: at most, the whole IR). The IR is only convolved up to there
+uint32_t ConvolutionReverb::Wet::getIrActiveLen(uint32_t decayCutPointSamples, float decayEnvSmoothingFactor) const
+{
+	const uint32_t envelopeLen = DspUtils::getDecayEnvelopeLength(decayCutPointSamples, decayEnvSmoothingFactor, DspUtils::dB2Lin(BCNRVRB_TAIL_FLOOR_DB, BCNRVRB_MIN_DB));
+
+	return juce::jmin(envelopeLen, m_irLen);
+}
+
+void ConvolutionReverb::Wet::getDecayEnvelope(float decay, uint32_t& decayCutPointSamples, float& decayEnvSmoothingFactor)
+{
+	decayCutPointSamples = m_irLen*decay;
+
+	const float decayEnvSmoothingTimeSamplesMax = 1.5f * m_config.samplerate; // 1.5 seconds
+	const float decayEnvSmoothingTimeSamples = juce::jmin(decayCutPointSamples * BCNRVRB_DECAY_ENVELOPE_PERCENTAGE, decayEnvSmoothingTimeSamplesMax);
+
+	decayEnvSmoothingFactor = DspUtils::getTimeConstantSamples(decayEnvSmoothingTimeSamples);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-void ConvolutionReverb::updateIr(void)
+bool ConvolutionReverb::Wet::irNeedsUpdate(float decayControl, float colorControl)
+{
+	if (m_irRebuildRequired)
+		return true;
+
+	float filterLpfCutoff, filterHpfCutoff;
+	m_reverb.getColorFilterCutoffs(colorControl, filterLpfCutoff, filterHpfCutoff);
+
+	// current values are only written by the IR updater, which is idle here:
+	return (m_reverb.getDecayFromDecayControl(decayControl) != m_decayCurrent)
+		|| (filterLpfCutoff != m_filterLPF[0].getCurrentFreq())
+		|| (filterHpfCutoff != m_filterHPF[0].getCurrentFreq());
+}
+
+// smoothing: if false, decay and color jump to their targets (instead of moving towards them)
+void ConvolutionReverb::Wet::updateIr(bool smoothing)
+{
+	beginIrUpdate(smoothing);
+
+	while (m_irUpdateSample < m_irLen)
+		updateIrCheckpoint();
+
+	m_convolutionEngine.updateIrBlocks(m_irUpdateIndex, m_irUpdateFirstSample); // only the freq. domain IR blocks that overlap the rewritten samples are recomputed
+
+	endIrUpdate();
+}
+
+void ConvolutionReverb::Wet::beginIrUpdate(bool smoothing)
 {
-	const uint8_t numChannels = m_numChannels;
+	const uint8_t numIrChannels = m_numIrChannels;
 	const uint32_t irLen = m_irLen;
+	const uint8_t irUpdateIndex = m_irUpdateIndex;
 
-	float* irPostProcessed[2] = { m_irPostProcessed[m_irUpdateIndex][0], m_irPostProcessed[m_irUpdateIndex][1] };
+	IrBufferParams& irBufferParams = m_irBufferParamsNext;
+	irBufferParams.valid = true;
 
-# if 0 // temporary: no processing
+	const float smoothingFactor = smoothing ? m_colorAndDecaySmoothingFactor : 0.0f;
+
+	updateDecayCurrent(m_decayControl, smoothingFactor, irBufferParams.decayCutPointSamples, irBufferParams.decayEnvSmoothingFactor);
+
+	// the partitions after the audible part of the decayed IR are skipped (the samples there keep being written, as the filter checkpoints need them):
+	m_convolutionEngine.updateIrActiveLen(irUpdateIndex, getIrActiveLen(irBufferParams.decayCutPointSamples, irBufferParams.decayEnvSmoothingFactor));
 
-	for (int ch=0; ch<numChannels; ch++)
 	{
-		for (uint32_t i=0; i<irLen; i++)
-			irPostProcessed[ch][i] = m_irPreProcessed[ch][i];
+		float filterLpfCutoff, filterHpfCutoff;
+		m_reverb.getColorFilterCutoffs(m_colorControl, filterLpfCutoff, filterHpfCutoff);
+
+		for (int ch=0; ch<numIrChannels; ch++)
+		{
+			m_filterLPF[ch].setTargetFreq(filterLpfCutoff, smoothingFactor, m_config.samplerate);
+			m_filterHPF[ch].setTargetFreq(filterHpfCutoff, smoothingFactor, m_config.samplerate);
+		}
+
+		irBufferParams.filterLpfCutoff = m_filterLPF[0].getCurrentFreq();
+		irBufferParams.filterHpfCutoff = m_filterHPF[0].getCurrentFreq();
 	}
 
-# else
+	// the buffer being updated was built 2 updates ago. If color is the same, only samples after the earliest decay cut point change:
+	const IrBufferParams& irBufferParamsPrev = m_irBufferParams[irUpdateIndex];
+	uint32_t firstSample = 0;
 
-	{ // decay processing:
-		const float decayTarget = getDecayFromDecayControl(m_decayControl);
+	if (irBufferParamsPrev.valid
+		&& (irBufferParamsPrev.filterLpfCutoff == irBufferParams.filterLpfCutoff)
+		&& (irBufferParamsPrev.filterHpfCutoff == irBufferParams.filterHpfCutoff))
+	{
+		const bool decayChanged = (irBufferParamsPrev.decayCutPointSamples != irBufferParams.decayCutPointSamples)
+			|| (irBufferParamsPrev.decayEnvSmoothingFactor != irBufferParams.decayEnvSmoothingFactor);
 
-		m_decayCurrent = DspUtils::expSmoothing(decayTarget, m_decayCurrent, m_colorAndDecaySmoothingFactor);
+		firstSample = decayChanged
+			? juce::jmin(irBufferParamsPrev.decayCutPointSamples, irBufferParams.decayCutPointSamples, irLen)
+			: irLen;
+	}
 
-		const uint32_t decayCutPointSamples = irLen*m_decayCurrent;
+	// resume from the last filter checkpoint (decay gain is still 1 there, as it is before both cut points):
+	const uint32_t firstCheckpoint = firstSample / BCNRVRB_IR_CHECKPOINT_LEN;
+	firstSample = (firstSample < irLen) ? firstCheckpoint * BCNRVRB_IR_CHECKPOINT_LEN : irLen;
 
-		const float decayEnvSmoothingTimeSamplesMax = 1.5f * m_samplerate; // 1.5 seconds
-		const float decayEnvSmoothingTimeSamples = juce::jmin(decayCutPointSamples * BCNRVRB_DECAY_ENVELOPE_PERCENTAGE, decayEnvSmoothingTimeSamplesMax);
-		const float decayEnvSmoothingFactor = DspUtils::getTimeConstantSamples(decayEnvSmoothingTimeSamples);
+# if 0 // temporary: no processing
+	firstSample = 0;
+# endif
 
-		float decayGainCurrent = 1.0f;
-	
-		for (uint32_t i=0; i<irLen; i++)
+	for (int ch=0; ch<numIrChannels; ch++)
+	{
+		if (firstSample == 0)
 		{
-			const float decayGainTarget = (i < decayCutPointSamples) ? 1.0f : 0.0f;
-			decayGainCurrent = DspUtils::expSmoothing(decayGainTarget, decayGainCurrent, decayEnvSmoothingFactor);
-
-			for (int ch=0; ch<numChannels; ch++)
-				irPostProcessed[ch][i] = m_irPreProcessed[ch][i] * decayGainCurrent;
+			m_filterLPF[ch].clearState();
+			m_filterHPF[ch].clearState();
+		}
+		else if (firstSample < irLen)
+		{
+			m_filterLPF[ch].setState(getIrFilterCheckpoint(irUpdateIndex, firstCheckpoint, ch, false));
+			m_filterHPF[ch].setState(getIrFilterCheckpoint(irUpdateIndex, firstCheckpoint, ch, true));
 		}
 	}
 
-	{ // color processing:
-		const bool filterIsLowPass = (m_colorControl <= 0.0f);
-		const float filterFc = filterIsLowPass
-			? getFilterLpfFcFromControl(1.0f + m_colorControl)
-			: getFilterHpfFcFromControl(m_colorControl);
+	m_irUpdateFirstSample = firstSample;
+	m_irUpdateSample = firstSample;
+	m_irUpdateDecayGain = 1.0f;
+	m_irUpdateBlock = 0;
+	m_irUpdateBlockCount = m_convolutionEngine.getIrBlockUpdateCount(irUpdateIndex, firstSample);
+}
 
-		const float filterLpfCutoff = filterIsLowPass ? filterFc : 20000.0f;
-		const float filterHpfCutoff = filterIsLowPass ? 20.0f : filterFc;
+// decay and color processing of the next checkpoint, saving the filter states at its start
+void ConvolutionReverb::Wet::updateIrCheckpoint(void)
+{
+	const uint8_t numIrChannels = m_numIrChannels;
+	const uint8_t irUpdateIndex = m_irUpdateIndex;
+	const uint32_t start = m_irUpdateSample;
+	const uint32_t len = juce::jmin(uint32_t(BCNRVRB_IR_CHECKPOINT_LEN), m_irLen - start);
+	const uint32_t checkpoint = start / BCNRVRB_IR_CHECKPOINT_LEN;
 
-		for (int ch=0; ch<numChannels; ch++)
+	float* const* irPostProcessed = m_irPostProcessed[irUpdateIndex];
+	const float* const* irPreProcessed = m_preparedIr->ir;
+
+# if 0 // temporary: no processing
+
+	for (int ch=0; ch<numIrChannels; ch++)
+	{
+		for (uint32_t i=start; i<start+len; i++)
+			irPostProcessed[ch][i] = irPreProcessed[ch][i];
+	}
+
+# else
+
+	{ // decay processing:
+		const uint32_t decayCutPointSamples = m_irBufferParamsNext.decayCutPointSamples;
+		const float decayEnvSmoothingFactor = m_irBufferParamsNext.decayEnvSmoothingFactor;
+
+		float decayGainCurrent = m_irUpdateDecayGain;
+
+		for (uint32_t i=start; i<start+len; i++)
 		{
-			m_filterLPF[ch].clearState();
-			m_filterLPF[ch].setTargetFreq(filterLpfCutoff, m_colorAndDecaySmoothingFactor, m_samplerate);
-			m_filterLPF[ch].process(irPostProcessed[ch], irPostProcessed[ch], irLen);
+			const float decayGainTarget = (i < decayCutPointSamples) ? 1.0f : 0.0f;
+			decayGainCurrent = DspUtils::expSmoothing(decayGainTarget, decayGainCurrent, decayEnvSmoothingFactor);
 
-			m_filterHPF[ch].clearState();
-			m_filterHPF[ch].setTargetFreq(filterHpfCutoff, m_colorAndDecaySmoothingFactor, m_samplerate);
-			m_filterHPF[ch].process(irPostProcessed[ch], irPostProcessed[ch], irLen);
+			for (int ch=0; ch<numIrChannels; ch++)
+				irPostProcessed[ch][i] = irPreProcessed[ch][i] * decayGainCurrent;
 		}
+
+		m_irUpdateDecayGain = decayGainCurrent;
+	}
+
+	// color processing:
+	for (int ch=0; ch<numIrChannels; ch++)
+	{
+		m_filterLPF[ch].getState(getIrFilterCheckpoint(irUpdateIndex, checkpoint, ch, false));
+		m_filterLPF[ch].process(&irPostProcessed[ch][start], &irPostProcessed[ch][start], len);
+
+		m_filterHPF[ch].getState(getIrFilterCheckpoint(irUpdateIndex, checkpoint, ch, true));
+		m_filterHPF[ch].process(&irPostProcessed[ch][start], &irPostProcessed[ch][start], len);
 	}
 
 # endif
 
+	m_irUpdateSample = start + len;
+}
+
+// kProcessingMode_RealtimeTimeSliced: one step of the IR update (a checkpoint, or a freq. domain IR block), on the audio thread
+void ConvolutionReverb::Wet::continueIrUpdate(void)
+{
+	if (m_irUpdateSample < m_irLen)
+		updateIrCheckpoint();
+	else if (m_irUpdateBlock < m_irUpdateBlockCount)
+		m_convolutionEngine.updateIrBlock(m_irUpdateIndex, m_irUpdateFirstSample, m_irUpdateBlock++);
+
+	if ((m_irUpdateSample >= m_irLen) && (m_irUpdateBlock >= m_irUpdateBlockCount))
+		endIrUpdate();
+}
+
+void ConvolutionReverb::Wet::endIrUpdate(void)
+{
+	m_irBufferParams[m_irUpdateIndex] = m_irBufferParamsNext;
+
 	m_updatingIr = false;
 }
 
@@ -19,35 +19,114 @@
 #include "ConvolutionEngine.h"
 #include "SamplerateConverter.h"
 #include "FilterBiquad.h"
-#include "IrBuffersAutoGenerated.h"
+#include "MemoryArena.h"
+#include "IrStore.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 
 class ConvolutionReverb
 {
+	friend class ConvolutionReverbBenchmark; // times reconfigure() and updateIr() on their own
+
 public:
 	ConvolutionReverb(void);
+	~ConvolutionReverb(void);
 
 	void init(void);
 	void exit(void);
 
+	// builds the whole reverb for these settings (call it after init(), off the audio thread: e.g. when preparing to play), so that process()
+	// starts right away. Set the processing mode first. Otherwise (or if the settings change later), the reverb is built in the background
+	// from process(), which outputs the dry signal only until it is ready. monoInput: stereo output from a mono input (see process()).
+	// expectedBlockSize: the host's (maximum) block size. It locks the internal block size and the latency until the next prepare()
+	void prepare(double samplerate, bool stereo, bool monoInput, int expectedBlockSize, int irIndex, float decayControl, float colorControl);
+
+	// a mono input on a stereo reverb is given as the same pointer for both channels (audioIn[0] == audioIn[1]): it is then convolved once per
+	// stage for both output channels. Switching between mono and stereo input is a settings change (see prepare())
     void process(const float* __restrict audioIn[2], float* __restrict audioOut[2], bool stereo, double samplerate, int blockSize, float decayControl, float colorControl, float dryWetControl, int irIndex);
 
+	// if enabled: color filters the wet signal and decay is applied as per-partition gains, so the IR is never reprocessed (knob changes are
+	// almost free, and its freq. domain blocks are shared by all the instances and disk-cached, see IrStore). Otherwise the IR itself is
+	// post-processed on every decay or color change (a smoother decay). Applied (rebuilding the reverb in the background) on the next process() call
+	inline void setDecayColorOnWetSignal(bool decayColorOnWetSignal)
+	{
+		m_decayColorOnWetSignalRequested = decayColorOnWetSignal;
+	}
+
+	// offline modes: every convolution stage and IR update is finished within process(), so the output only depends on the input.
+	// kProcessingMode_RealtimeTimeSliced: no DSP threads, the work is spread over the process() calls instead (see ProcessingMode).
+	// Switched in place on the next process() call, with no rebuild or mute (see updateProcessingMode()). Only from a mode with no DSP threads
+	// to one with them, the reverb may need to be rebuilt in the background (if it was never built with the DSP thread pool)
+	inline void setProcessingMode(ProcessingMode processingMode)
+	{
+		m_processingModeRequested = processingMode;
+	}
+
+	// for callers which only ever process blocks of a multiple of the internal block size (e.g. an offline renderer with its own fixed block
+	// size): when the expected block size is one, blocks are split with no latency, and the internal block can be as large as BCNRVRB_MAX_BLOCK_SIZE.
+	// Plugin hosts can't promise it (their block size is only a maximum, and a shorter block can't be processed in place without delaying the
+	// wet signal), so it is off by default. Applied by prepare()
+	inline void setFixedBlockSize(bool fixedBlockSize)
+	{
+		m_fixedBlockSize = fixedBlockSize;
+	}
+
+	// latency, in samples. Set by prepare() from the expected block size (or by the first process() call, if not prepared), and constant
+	// until the next prepare() (see getLatencySamples(int, bool))
+	inline int getLatencySamples(void) const
+	{
+		return static_cast<int>(m_latencySamples);
+	}
+
+	// latency for a given expected block size (to report it before processing). Host blocks of any size are re-blocked through a FIFO into
+	// internal power of 2 blocks (the largest one not above expectedBlockSize, nor BCNRVRB_REBLOCK_MAX_BLOCK_SIZE), with one internal block of
+	// latency. fixedBlockSize: see setFixedBlockSize() (no latency, if expectedBlockSize is a multiple of the internal block size)
+	static int getLatencySamples(int expectedBlockSize, bool fixedBlockSize);
+
+	// length of the reverb tail (the IR length at samplerate), to render it in full after the input ends
+	static uint32_t getTailLengthSamples(int irIndex, double samplerate);
+
+	// length of the reverb tail as it sounds now, in seconds (can be called from any thread): until the decay envelope falls below
+	// BCNRVRB_TAIL_FLOOR_DB (at most the IR length), plus the latency. Updated on every process() call, as the decay or the IR change
+	inline float getTailLengthSeconds(void) const
+	{
+		return m_tailLengthSeconds.load(std::memory_order_relaxed);
+	}
+
 private:
+	struct WetConfig; // see below
+	class Wet;
+
+	void processBlock(const float* __restrict audioIn[2], float* __restrict audioOut[2], float decayControl, float colorControl, float dryWetControl);
+	static uint32_t getInternalBlockSize(int expectedBlockSize, bool fixedBlockSize);
 	void reconfigure(void);
-	void updateIr(void);
+	void configureBlocks(int expectedBlockSize);
+	void configureSamplerate(void);
+	void updateProcessingMode(void);
+	WetConfig getWetConfig(void) const;
+	void updateWetSwitch(float decayControl, float colorControl);
+	void updateTailLength(float decayControl);
+	void requestIrLoader(uint8_t irLoaderState, float decayControl, float colorControl);
+	void runIrLoaderRequest(void);
+	void waitForIrLoader(void);
+	static void getIrLen(int irIndex, double samplerate, uint32_t& irLen, uint32_t& irLenWithZeros);
+	static uint8_t getIrChannelCount(int irIndex, uint8_t numChannels);
 
 public:
-	static constexpr int getIrCount(void)
+	// the compiled-in IRs, followed by the ones of the providers added to IrStore (e.g. audio files, see IrFileProvider)
+	static inline int getIrCount(void)
 	{
-		return IrBuffers::getIrCount();
+		return IrStore::getIrCount();
 	}
 
-	inline char* getIrName(int irIndex)
+	static inline const char* getIrName(int irIndex)
 	{
-		return m_impulseResponses.getIrName(irIndex);
+		return IrStore::getIrName(irIndex);
 	}
 
+	// stageBlockSize: BCNRVRB_SMALLEST_STAGE_SIZE ... BCNRVRB_LONGEST_STAGE_SIZE (powers of 2). missRunInlineCount: misses finished on the audio thread before any worker started them
+	void getDeadlineMissCounts(uint32_t stageBlockSize, uint32_t& missCount, uint32_t& missRunInlineCount);
+
 private:
 	inline float getParamVolumeControltodB(float volumeControl)
 	{
@@ -112,24 +191,227 @@ private:
 		return getParamArrayValueInterpolated(decayControl, m_arrayDecayInterp);
 	}
 
+	inline void getColorFilterCutoffs(float colorControl, float& filterLpfCutoff, float& filterHpfCutoff)
+	{
+		const bool filterIsLowPass = (colorControl <= 0.0f);
+		const float filterFc = filterIsLowPass
+			? getFilterLpfFcFromControl(1.0f + colorControl)
+			: getFilterHpfFcFromControl(colorControl);
+
+		filterLpfCutoff = filterIsLowPass ? filterFc : 20000.0f;
+		filterHpfCutoff = filterIsLowPass ? 20.0f : filterFc;
+	}
+
+private:
+	// what a wet path is prepared for (changing any of these needs a new one)
+	struct WetConfig
+	{
+		int irIndex = -1;
+		float samplerate = BCNRVRB_DEFAULT_IR_SAMPLERATE;
+		uint32_t blockSize = 16; // internal block size
+		uint8_t numChannels = 2;
+		uint8_t numInputChannels = 2; // numChannels, or 1 for a mono input
+		ProcessingMode processingMode = kProcessingMode_Realtime;
+		bool decayColorOnWetSignal = false; // see setDecayColorOnWetSignal()
+
+		// same configuration, maybe with another IR: wet paths which can be crossfaded
+		inline bool isCompatible(const WetConfig& other) const
+		{
+			return (irIndex >= 0) && (other.irIndex >= 0) && (samplerate == other.samplerate) && (blockSize == other.blockSize) && (numChannels == other.numChannels) && (numInputChannels == other.numInputChannels) && (processingMode == other.processingMode) && (decayColorOnWetSignal == other.decayColorOnWetSignal);
+		}
+
+		inline bool operator==(const WetConfig& other) const
+		{
+			return isCompatible(other) && (irIndex == other.irIndex);
+		}
+	};
+
+	// the convolution engine with its IR, and the IR post-processing (decay and color). There are two of them, so that a new IR (or
+	// configuration) can be prepared off the audio thread while the current one keeps playing, and then switched to (see updateWetSwitch())
+	class Wet
+	{
+		friend class ConvolutionReverb;
+		friend class ConvolutionReverbBenchmark;
+
+	public:
+		Wet(ConvolutionReverb& reverb);
+		~Wet(void);
+
+		void init(void);
+		void exit(void);
+
+		void configure(const WetConfig& config);
+		void release(void);
+		void buildIr(float decayControl, float colorControl);
+		bool canSetProcessingMode(ProcessingMode processingMode) const;
+		void setProcessingMode(ProcessingMode processingMode);
+
+		void process(const float* __restrict audioIn[2], float* __restrict audioOut[2], float decayControl, float colorControl);
+
+		inline int getIrIndex(void) const
+		{
+			return m_config.irIndex;
+		}
+
+		uint32_t getTailLengthSamples(float decay);
+
+	private:
+		void allocateBuffers(uint32_t irBufferLen);
+		void allocateSharedBuffers(MemoryArena& arena, float* ir[BCNRVRB_MAX_IR_CHANNELS], uint32_t irBufferLen);
+		void prepareIr(float* ir[BCNRVRB_MAX_IR_CHANNELS], uint32_t irLenWithZeros);
+		void updateDecayCurrent(float decayControl, float smoothingFactor, uint32_t& decayCutPointSamples, float& decayEnvSmoothingFactor);
+		void getDecayEnvelope(float decay, uint32_t& decayCutPointSamples, float& decayEnvSmoothingFactor);
+		uint32_t getIrActiveLen(uint32_t decayCutPointSamples, float decayEnvSmoothingFactor) const;
+
+		// decay and color on the IR (!m_config.decayColorOnWetSignal):
+		bool irNeedsUpdate(float decayControl, float colorControl);
+		void updateIr(bool smoothing);
+		void beginIrUpdate(bool smoothing);
+		void updateIrCheckpoint(void);
+		void continueIrUpdate(void);
+		void endIrUpdate(void);
+
+		inline double* getIrFilterCheckpoint(uint8_t irIndex, uint32_t checkpoint, uint8_t ch, bool highPass)
+		{
+			const uint32_t index = ((irIndex * m_irFilterCheckpointCount + checkpoint) * m_numIrChannels + ch) * 2 + (highPass ? 1 : 0);
+
+			return &m_irFilterCheckpoints[index * FilterBiquad::kState_Count];
+		}
+
+	private:
+		ConvolutionReverb& m_reverb; // the parameter tables
+
+		WetConfig m_config; // irIndex is -1 when released
+		uint8_t m_numIrChannels = 2; // m_config.numChannels, or 4 when a true-stereo IR is used with stereo audio
+
+		ConvolutionEngine m_convolutionEngine;
+
+		MemoryArena m_arena; // holds all the per-instance IR and convolution engine buffers, sized on every configure()
+
+		uint32_t m_irLen = 0;
+		std::shared_ptr<const IrStore::PreparedIr> m_preparedIr; // resampled and normalized IR (pre-processed), shared with other instances
+
+		// decay and color on the IR (!m_config.decayColorOnWetSignal):
+		float* m_irPostProcessed[2][BCNRVRB_MAX_IR_CHANNELS] = {}; // 2 buffers of m_numIrChannels channels
+		std::atomic<uint8_t> m_irUpdateIndex = 0; // indicates which IR buffer is currently being updated
+		static_assert(std::atomic<uint8_t>::is_always_lock_free);
+
+		struct IrBufferParams
+		{
+			bool valid = false;
+			uint32_t decayCutPointSamples = 0;
+			float decayEnvSmoothingFactor = 0.0f;
+			float filterLpfCutoff = 0.0f;
+			float filterHpfCutoff = 0.0f;
+		};
+
+		IrBufferParams m_irBufferParams[2]; // parameters each post-processed IR buffer was last built with (IR updater only)
+		IrBufferParams m_irBufferParamsNext; // parameters of the IR buffer being updated (IR updater only)
+
+		// progress of the IR update (IR updater only). kProcessingMode_RealtimeTimeSliced: it runs on the audio thread, one step per process() call (see continueIrUpdate())
+		uint32_t m_irUpdateFirstSample = 0; // first changed sample (checkpoint aligned)
+		uint32_t m_irUpdateSample = 0; // next sample to post-process (one checkpoint at a time)
+		float m_irUpdateDecayGain = 1.0f;
+		uint32_t m_irUpdateBlock = 0; // next freq. domain IR block to recompute
+		uint32_t m_irUpdateBlockCount = 0;
+
+		double* m_irFilterCheckpoints = nullptr; // [IR buffer][checkpoint][IR ch][LPF, HPF][FilterBiquad::kState_Count]: filter states every BCNRVRB_IR_CHECKPOINT_LEN samples, to resume processing mid-IR (IR updater only)
+		uint32_t m_irFilterCheckpointCount = 0;
+		bool m_irUpdatePending = false; // the last updated IR buffer has not been switched to yet (audio thread only)
+		bool m_irRebuildRequired = true; // set after configuring, when no IR buffer is valid (audio thread only)
+
+		std::atomic<float> m_colorControl = 0.0f;
+		FilterBiquad m_filterLPF[BCNRVRB_MAX_IR_CHANNELS], m_filterHPF[BCNRVRB_MAX_IR_CHANNELS]; // one per IR channel (one per output channel when filtering the wet signal)
+
+		std::atomic<float> m_decayControl = 0.0f;
+		float m_decayCurrent = 1.0f;
+
+		float m_colorAndDecaySmoothingFactor = 0.0f;
+
+		float m_colorWetSmoothingFactor = 0.0f; // color filters are smoothed once per audio block (m_config.decayColorOnWetSignal only)
+
+		DspJob m_irUpdateJob; // runs updateIr() on the DSP thread pool
+		std::shared_ptr<DspThreadPool> m_threadPool; // acquired in the DSP thread pool modes: for the IR updater, and for the engine after a processing mode switch
+
+		std::atomic<bool> m_updatingIr = false;
+		static_assert(std::atomic<bool>::is_always_lock_free);
+	};
+
+	// prepares the next wet path when the IR or the configuration changes, and releases the previous one after the switch. Not a DSP thread: it is idle
+	// unless they change, and it is not used in the offline modes (their requests are run right away on the calling thread)
+	class IrLoader : public juce::Thread
+	{
+	public:
+		IrLoader(ConvolutionReverb& reverb) : juce::Thread("BarcelonaReverbera IR loader"), m_reverb(reverb) {}
+
+		void run(void) override
+		{
+			while (!threadShouldExit())
+			{
+				if (wait(-1.0))
+				{
+					if (threadShouldExit())
+						break;
+
+					m_reverb.runIrLoaderRequest();
+				}
+			}
+		}
+
+	private:
+		ConvolutionReverb& m_reverb;
+	};
+
+	enum IrLoaderState
+	{
+		kIrLoaderState_Idle = 0,
+		kIrLoaderState_Load, // requested: configure the next wet path for m_irLoaderConfig and build its IR
+		kIrLoaderState_Loaded, // the next wet path is ready to be crossfaded to
+		kIrLoaderState_Release, // requested: release the next wet path (the previous one, after the crossfade)
+	};
+
 private:
-	uint32_t m_blockSize = 16;
+	uint32_t m_blockSize = 16; // internal block size
+	bool m_blocksConfigured = false; // the internal block size and the latency are locked (see prepare())
+	bool m_fixedBlockSize = false; // see setFixedBlockSize()
 	float m_samplerate = BCNRVRB_DEFAULT_IR_SAMPLERATE;
 	uint8_t m_numChannels = 2;
+	uint8_t m_numInputChannels = 2; // m_numChannels, or 1 for a mono input (see process())
+
+	int m_irIndex = -1; // the requested IR (the playing one may still be another, see updateWetSwitch())
+
+	ProcessingMode m_processingMode = kProcessingMode_Realtime;
+	ProcessingMode m_processingModeRequested = kProcessingMode_Realtime;
 
-	int m_irIndex = -1;
+	bool m_decayColorOnWetSignal = false; // see setDecayColorOnWetSignal()
+	bool m_decayColorOnWetSignalRequested = false;
 
-	IrBuffers m_impulseResponses;
-	ConvolutionEngine m_convolutionEngine;
+	Wet m_wet[2];
+	uint8_t m_wetIndex = 0; // the wet path playing (or being crossfaded to)
+	bool m_wetMuted = true; // the playing wet path is not configured as the reverb is now (only the dry signal is output, until its rebuild is ready)
+
+	uint32_t m_crossfadePos = 0; // samples of the IR crossfade done so far (m_crossfadeLen when there is none)
+	uint32_t m_crossfadeLen = 0;
+	alignas(16) float m_audioWetPrev[2][BCNRVRB_MAX_BLOCK_SIZE] = {}; // output of the wet path being faded out
+
+	IrLoader m_irLoader;
+	std::atomic<uint8_t> m_irLoaderState = kIrLoaderState_Idle;
+	static_assert(std::atomic<uint8_t>::is_always_lock_free);
+	uint8_t m_irLoaderWetIndex = 1; // request parameters, written before m_irLoaderState
+	WetConfig m_irLoaderConfig;
+	float m_irLoaderDecayControl = 0.0f;
+	float m_irLoaderColorControl = 0.0f;
 
     alignas(16) float m_audioDry[2][BCNRVRB_MAX_BLOCK_SIZE] = {};
     alignas(16) float m_audioReverbIn[2][BCNRVRB_MAX_BLOCK_SIZE] = {};
 
-	uint32_t m_irLen = 0;
-	alignas(16) float m_irPreProcessed[2][BCNRVRB_IR_MAX_LEN_SAMPLES] = {}; // 1 stereo buffer
-	alignas(16) float m_irPostProcessed[2][2][BCNRVRB_IR_MAX_LEN_SAMPLES] = {}; // 2 stereo buffers
-	std::atomic<uint8_t> m_irUpdateIndex = 0; // indicates which IR buffer is currently being updated
-	static_assert(std::atomic<uint8_t>::is_always_lock_free);
+	// re-blocking FIFOs (unless m_latencySamples is 0): input gathered for the next internal block, and output of the previous one
+	alignas(16) float m_reblockIn[2][BCNRVRB_MAX_BLOCK_SIZE] = {};
+	alignas(16) float m_reblockOut[2][BCNRVRB_MAX_BLOCK_SIZE] = {};
+	uint32_t m_reblockPos = 0;
+	uint32_t m_latencySamples = 0;
+
+	std::atomic<float> m_tailLengthSeconds = BCNRVRB_MAX_IR_LEN_SECONDS; // see getTailLengthSeconds()
 
 	float m_dryCurrent = 0.0f;
 	float m_wetCurrent = 0.0f;
@@ -138,23 +420,12 @@ private:
 	uint32_t m_dryWetRecalculateTimesPerBlock = 1;
 	float m_dryWetSmoothingFactor = 0.0f;
 
-	std::atomic<float> m_colorControl = 0.0f;
-	FilterBiquad m_filterLPF[2], m_filterHPF[2];
 	float m_arrayFilterLpfFcInterp[BCNRVRB_PARAM_INTERPOL_ARRAY_LEN] = {};
 	float m_arrayFilterHpfFcInterp[BCNRVRB_PARAM_INTERPOL_ARRAY_LEN] = {};
 
-	std::atomic<float> m_decayControl = 0.0f;
 	float m_arrayDecayInterp[BCNRVRB_PARAM_INTERPOL_ARRAY_LEN] = {};
-	float m_decayCurrent = 1.0f;
 
 	static_assert(std::atomic<float>::is_always_lock_free);
-
-	float m_colorAndDecaySmoothingFactor = 0.0f;
-
-	DspThread m_thread;
-
-	std::atomic<bool> m_updatingIr = false;
-	static_assert(std::atomic<bool>::is_always_lock_free);
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -29,10 +29,17 @@
 
 #define BCNRVRB_MAX_BLOCK_SIZE									(8*1024)
 #define BCNRVRB_MIN_BLOCK_SIZE									(16)
+#define BCNRVRB_REBLOCK_MAX_BLOCK_SIZE							(64) // largest internal block when host blocks are re-blocked (see ConvolutionReverb::setFixedBlockSize()): it is the latency
 
 #define BCNRVRB_MAX_IR_LEN_SECONDS								(10)
 #define BCNRVRB_IR_MAX_LEN_SAMPLES								(BCNRVRB_MAX_SAMPLERATE*BCNRVRB_MAX_IR_LEN_SECONDS)
-#define BCNRVRB_IR_MIN_LEN_SAMPLES								(3*BCNRVRB_MAX_BLOCK_SIZE) // requirement due to the algorithm used
+#define BCNRVRB_IR_MIN_LEN_SAMPLES								(2*BCNRVRB_LONGEST_STAGE_SIZE + 1) // requirement due to the algorithm used: the longest stage needs a block at least
+#define BCNRVRB_IR_EXTRA_ZEROS									(16*1024) // zeros after the IR in its buffers (as in the compiled-in IRs)
+#define BCNRVRB_IR_NOISE_FLOOR_MARGIN_DB						(3.0f) // IRs are cut where their decay falls to this above their measurement noise floor (see IrStore::setNoiseFloorMargin())
+#define BCNRVRB_IR_NOISE_FLOOR_FADE_MS							(10.0f) // fade-out after that point
+
+#define BCNRVRB_MAX_IR_CHANNELS									(4) // true-stereo IRs: one channel per input/output channel pair (see BCNRVRB_TRUE_STEREO_IR_CHANNEL())
+#define BCNRVRB_TRUE_STEREO_IR_CHANNEL(inCh, outCh)				((inCh) * 2 + (outCh)) // LL, LR, RL, RR. Mono and stereo IRs are channel-parallel instead (input channel n only feeds output channel n)
 
 #define BCNRVRB_SMALLEST_STAGE_SIZE								(64)
 #define BCNRVRB_LONGEST_STAGE_SIZE								(16*1024)
@@ -41,6 +48,7 @@
 #define BCNRVRB_PARAM_INTERPOL_ARRAY_LEN						(1024)
 
 #define BCNRVRB_DRYWET_SMOOTH_LEN_MS							(5.0f)
+#define BCNRVRB_IR_CROSSFADE_LEN_MS								(50.0f) // equal-power crossfade of the wet signal when the IR changes
 
 #define BCNRVRB_COLOR_LPF_FREQ_MIN								(220.0) // 220 Hz
 #define BCNRVRB_COLOR_HPF_FREQ_MAX								(3000.0) // 3 kHz
@@ -55,8 +63,23 @@
 #define	BCNRVRB_DECAY_KNOB_DECADES								(2.15f) // knob behavior
 #define BCNRVRB_DECAY_ENVELOPE_PERCENTAGE						(2.3f) // exp. decaying part is 230% of the full gain part
 
+#define BCNRVRB_IR_CHECKPOINT_LEN								(BCNRVRB_LONGEST_STAGE_SIZE) // IR updates only reprocess from the last checkpoint before the first changed sample
+
 #define BCNRVRB_MIN_DB											(-120.0f)
 
+#define BCNRVRB_INPUT_SILENCE_ENERGY_PER_SAMPLE					(1.0e-20f) // -200 dBFS mean power: below it, an audio block of the input is silence and the convolution stages idle
+#define BCNRVRB_TAIL_FLOOR_DB									(-90.0f) // the reported tail ends where the decay envelope falls below this
+
+///////////////////////////////////////////////////////////////////////////////
+
+enum ProcessingMode
+{
+	kProcessingMode_Realtime = 0, // the larger convolution stages run on the DSP thread pool, due by the time their output is needed
+	kProcessingMode_Offline, // as realtime, but the thread pool jobs are joined within every process() call (deterministic: nothing depends on timing)
+	kProcessingMode_OfflineSingleThread, // all the convolution stages are processed inline within process() (deterministic, no DSP threads)
+	kProcessingMode_RealtimeTimeSliced, // as realtime, with no DSP threads: the larger stages' work (and the IR updates) is split into slices, one per process() call
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 
 #define BCNRVRB_COLOR_BLACK										(0xFF000000)
@@ -120,6 +143,37 @@ public:
 		return y0 * (1.0f - mu) + (y1 * mu);
 	}
 
+	// mean gain over [start, start + len) of the decay envelope: 1 before cutPoint, then envSmoothingFactor^(i - cutPoint + 1)
+	static inline float getDecayEnvelopeMean(uint32_t start, uint32_t len, uint32_t cutPoint, float envSmoothingFactor)
+	{
+		const uint32_t end = start + len;
+
+		if (end <= cutPoint)
+			return 1.0f;
+
+		double sum = (cutPoint > start) ? double(cutPoint - start) : 0.0;
+
+		const uint32_t decayStart = (cutPoint > start) ? cutPoint : start;
+		const double logRate = std::log(double(envSmoothingFactor));
+
+		// geometric series: r^(decayStart - cutPoint + 1) * (1 - r^(end - decayStart)) / (1 - r)
+		sum += std::exp(logRate * double(decayStart - cutPoint + 1)) * std::expm1(logRate * double(end - decayStart)) / std::expm1(logRate);
+
+		return float(sum / double(len));
+	}
+
+	// samples until the decay envelope (see getDecayEnvelopeMean()) falls below floorLin (UINT32_MAX if it never does)
+	static inline uint32_t getDecayEnvelopeLength(uint32_t cutPoint, float envSmoothingFactor, float floorLin)
+	{
+		if ((envSmoothingFactor <= 0.0f) || (envSmoothingFactor >= 1.0f) || (floorLin <= 0.0f))
+			return UINT32_MAX;
+
+		if (floorLin >= 1.0f)
+			return cutPoint;
+
+		return cutPoint + uint32_t(std::ceil(std::log(double(floorLin)) / std::log(double(envSmoothingFactor))));
+	}
+
 	static inline void smoothParameter(const float target, float& futureCurrent, float& current, float& incr, const float smoothingFactor, uint32_t blockSize)
 	{
 		current = futureCurrent;
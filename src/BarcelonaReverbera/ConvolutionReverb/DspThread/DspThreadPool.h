@@ -0,0 +1,372 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+#include "DspThread.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define DSP_THREAD_POOL_NUM_THREADS				(0) // default worker count, for both lanes together (see DspThreadPool::setNumThreads()). 0: one per physical CPU core
+#define DSP_THREAD_POOL_QUEUE_LEN				(256) // max. jobs waiting in each worker's queue
+
+///////////////////////////////////////////////////////////////////////////////
+
+// A piece of work that is run on the DspThreadPool every time it is submitted, before a deadline. A job never runs concurrently with itself:
+// submitting it while it is queued does nothing, and submitting it while it runs makes it run once more afterwards (like DspThread::notify()).
+class DspJob
+{
+public:
+	// workers can't preempt a running job, so long jobs get their own (lower priority) workers and never delay the short ones
+	enum Lane : uint8_t
+	{
+		kLane_Short = 0, // short deadlines (small convolution stages)
+		kLane_Long, // long deadlines (large convolution stages, IR updates)
+		kLane_Count
+	};
+
+	DspJob(Lane lane, std::function<void(void)> const & funcProcess) : m_lane(lane), m_funcProcess(funcProcess) {}
+
+	inline bool isIdle(void) const
+	{
+		return m_state == kState_Idle;
+	}
+
+private:
+	friend class DspThreadPool;
+
+	enum State : uint8_t
+	{
+		kState_Idle = 0,
+		kState_Queued,
+		kState_Running,
+		kState_RunningAndSubmitted // submitted again while running
+	};
+
+	const Lane m_lane;
+	std::function<void(void)> m_funcProcess;
+
+	std::atomic<uint8_t> m_state = kState_Idle;
+	static_assert(std::atomic<uint8_t>::is_always_lock_free);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Process-wide pool of DSP worker threads, shared by all the reverb instances (instead of one thread per convolution stage and instance).
+// Jobs are queued on the workers of their lane round-robin. Workers always run the queued job of their lane with the earliest deadline,
+// whichever queue it is in (earliest-deadline-first, with idle workers stealing jobs from busy ones).
+// The pool is started by the first acquire() and stopped when the last user releases it.
+class DspThreadPool
+{
+public:
+	// total worker count (0: one per physical CPU core), split between both lanes (one worker each, at least). It applies when the pool is
+	// started: set it before the first acquire() (or once all the users have released the pool)
+	static void setNumThreads(int numThreads)
+	{
+		m_numThreads = numThreads;
+	}
+
+	static std::shared_ptr<DspThreadPool> acquire(void)
+	{
+		static std::mutex mutex;
+		static std::weak_ptr<DspThreadPool> instance;
+
+		const std::lock_guard<std::mutex> lock(mutex);
+
+		std::shared_ptr<DspThreadPool> threadPool = instance.lock();
+
+		if (threadPool == nullptr)
+		{
+			threadPool.reset(new DspThreadPool());
+			instance = threadPool;
+		}
+
+		return threadPool;
+	}
+
+	~DspThreadPool(void)
+	{
+		for (auto& workers : m_workers)
+		{
+			for (auto& worker : workers)
+				DEBUG_VERIFY(worker->thread->stopThread(2000));
+		}
+	}
+
+	inline uint32_t getNumWorkers(DspJob::Lane lane) const
+	{
+		return uint32_t(m_workers[lane].size());
+	}
+
+	static inline int64_t getTimeNs(void)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// called from the audio thread (never blocks on the workers). deadlineNs: time from now until the job's results are needed
+	inline void submit(DspJob& job, int64_t deadlineNs)
+	{
+		uint8_t state = job.m_state;
+
+		while (true)
+		{
+			if ((state == DspJob::kState_Queued) || (state == DspJob::kState_RunningAndSubmitted))
+				return; // it will run (again) anyway
+
+			const uint8_t newState = (state == DspJob::kState_Idle) ? DspJob::kState_Queued : DspJob::kState_RunningAndSubmitted;
+
+			if (job.m_state.compare_exchange_weak(state, newState))
+			{
+				if (newState == DspJob::kState_Queued)
+					enqueue(job, getTimeNs() + deadlineNs);
+
+				return;
+			}
+		}
+	}
+
+	// waits until job has finished running (it must not be submitted meanwhile)
+	inline void wait(DspJob& job)
+	{
+		while (!job.isIdle())
+			juce::Thread::yield();
+	}
+
+	// for a job that is late: runs it on the calling thread if no worker has taken it yet (returns true), otherwise returns false
+	inline bool runIfQueued(DspJob& job)
+	{
+		for (auto& worker : m_workers[job.m_lane])
+		{
+			if (remove(*worker, &job))
+			{
+				DEBUG_VERIFY(claim(job));
+				run(job);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+private:
+	struct QueueEntry
+	{
+		DspJob* job;
+		int64_t deadlineNs; // absolute (see getTimeNs())
+	};
+
+	struct Worker
+	{
+		std::unique_ptr<DspThread> thread;
+
+		juce::SpinLock queueLock;
+		QueueEntry queue[DSP_THREAD_POOL_QUEUE_LEN] = {}; // binary heap, earliest deadline first
+		uint32_t queueCount = 0;
+
+		std::atomic<bool> busy = false;
+		static_assert(std::atomic<bool>::is_always_lock_free);
+	};
+
+	DspThreadPool(void)
+	{
+		const int numThreadsSetting = m_numThreads;
+		const int numThreads = juce::jmax(int(DspJob::kLane_Count), (numThreadsSetting > 0) ? numThreadsSetting : juce::SystemStats::getNumPhysicalCpus());
+		const int numLongThreads = numThreads / 2; // the smaller half: long jobs have plenty of time until their deadlines
+		const int numLaneThreads[DspJob::kLane_Count] = { numThreads - numLongThreads, numLongThreads };
+
+		for (uint8_t lane=0; lane<DspJob::kLane_Count; lane++)
+		{
+			auto& workers = m_workers[lane];
+
+			for (int i=0; i<numLaneThreads[lane]; i++)
+			{
+				workers.push_back(std::make_unique<Worker>());
+
+				Worker* worker = workers.back().get();
+				const juce::String name = juce::String((lane == DspJob::kLane_Short) ? "DspThreadPoolShort_" : "DspThreadPoolLong_") + juce::String(i);
+
+				worker->thread = std::make_unique<DspThread>(name, [] () { }, [] () { }, [this, worker, lane] () { processJobs(*worker, DspJob::Lane(lane)); });
+			}
+
+			for (auto& worker : workers)
+			{
+#			  if JUCE_MAC
+				worker->thread->startRealtimeThread(juce::Thread::RealtimeOptions{}.withPriority((lane == DspJob::kLane_Short) ? 9 : 8));
+#			  else
+				//worker->thread->startRealtimeThread(juce::Thread::RealtimeOptions{}.withPriority((lane == DspJob::kLane_Short) ? 9 : 8)); // XXX not working on linux?
+				worker->thread->startThread((lane == DspJob::kLane_Short) ? juce::Thread::Priority::highest : juce::Thread::Priority::high);
+#			  endif
+			}
+		}
+	}
+
+	static inline bool isLater(const QueueEntry& a, const QueueEntry& b)
+	{
+		return a.deadlineNs > b.deadlineNs;
+	}
+
+	inline bool push(Worker& worker, DspJob* job, int64_t deadlineNs)
+	{
+		const juce::SpinLock::ScopedLockType lock(worker.queueLock);
+
+		if (worker.queueCount == DSP_THREAD_POOL_QUEUE_LEN)
+			return false;
+
+		worker.queue[worker.queueCount++] = { job, deadlineNs };
+		std::push_heap(worker.queue, worker.queue + worker.queueCount, isLater);
+
+		return true;
+	}
+
+	inline DspJob* pop(Worker& worker)
+	{
+		const juce::SpinLock::ScopedLockType lock(worker.queueLock);
+
+		if (worker.queueCount == 0)
+			return nullptr;
+
+		std::pop_heap(worker.queue, worker.queue + worker.queueCount, isLater);
+
+		return worker.queue[--worker.queueCount].job;
+	}
+
+	inline bool remove(Worker& worker, DspJob* job)
+	{
+		const juce::SpinLock::ScopedLockType lock(worker.queueLock);
+
+		for (uint32_t i=0; i<worker.queueCount; i++)
+		{
+			if (worker.queue[i].job == job)
+			{
+				worker.queue[i] = worker.queue[--worker.queueCount];
+				std::make_heap(worker.queue, worker.queue + worker.queueCount, isLater);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	inline int64_t getEarliestDeadlineNs(Worker& worker)
+	{
+		const juce::SpinLock::ScopedLockType lock(worker.queueLock);
+
+		return (worker.queueCount > 0) ? worker.queue[0].deadlineNs : INT64_MAX;
+	}
+
+	inline void enqueue(DspJob& job, int64_t deadlineNs)
+	{
+		auto& workers = m_workers[job.m_lane];
+		const uint32_t numWorkers = getNumWorkers(job.m_lane);
+		const uint32_t first = m_nextWorker[job.m_lane].fetch_add(1) % numWorkers;
+
+		for (uint32_t i=0; i<numWorkers; i++)
+		{
+			Worker& worker = *workers[(first + i) % numWorkers];
+
+			if (push(worker, &job, deadlineNs))
+			{
+				worker.thread->notify();
+
+				if (worker.busy) // wake up an idle worker, to steal it
+				{
+					for (auto& other : workers)
+					{
+						if (!other->busy)
+						{
+							other->thread->notify();
+							break;
+						}
+					}
+				}
+
+				return;
+			}
+		}
+
+		DEBUG_ASSERT(false); // all queues full: run it here rather than losing it
+		DEBUG_VERIFY(claim(job));
+		run(job);
+	}
+
+	// the earliest deadline of all the queues in the lane (the worker's own queue wins ties)
+	inline DspJob* getNextJob(Worker& worker, DspJob::Lane lane)
+	{
+		Worker* earliest = &worker;
+		int64_t earliestDeadlineNs = getEarliestDeadlineNs(worker);
+
+		for (auto& other : m_workers[lane])
+		{
+			if (other.get() != &worker)
+			{
+				const int64_t deadlineNs = getEarliestDeadlineNs(*other);
+
+				if (deadlineNs < earliestDeadlineNs)
+				{
+					earliest = other.get();
+					earliestDeadlineNs = deadlineNs;
+				}
+			}
+		}
+
+		if (DspJob* job = pop(*earliest))
+			return job;
+
+		// another worker took it meanwhile: anything left
+		for (auto& other : m_workers[lane])
+		{
+			if (DspJob* job = pop(*other))
+				return job;
+		}
+
+		return nullptr;
+	}
+
+	inline void processJobs(Worker& worker, DspJob::Lane lane)
+	{
+		worker.busy = true;
+
+		while (DspJob* job = getNextJob(worker, lane))
+		{
+			DEBUG_VERIFY(claim(*job));
+			run(*job);
+		}
+
+		worker.busy = false;
+	}
+
+	static inline bool claim(DspJob& job)
+	{
+		uint8_t state = DspJob::kState_Queued;
+
+		return job.m_state.compare_exchange_strong(state, DspJob::kState_Running);
+	}
+
+	// the job must have been claimed
+	inline void run(DspJob& job)
+	{
+		uint8_t state;
+
+		while (true)
+		{
+			job.m_funcProcess();
+
+			state = DspJob::kState_Running;
+
+			if (job.m_state.compare_exchange_strong(state, DspJob::kState_Idle))
+				return;
+
+			job.m_state = DspJob::kState_Running; // it was submitted again while running
+		}
+	}
+
+private:
+	static inline std::atomic<int> m_numThreads { DSP_THREAD_POOL_NUM_THREADS }; // see setNumThreads()
+
+	std::vector<std::unique_ptr<Worker>> m_workers[DspJob::kLane_Count];
+	std::atomic<uint32_t> m_nextWorker[DspJob::kLane_Count] = {};
+};
+
+///////////////////////////////////////////////////////////////////////////////
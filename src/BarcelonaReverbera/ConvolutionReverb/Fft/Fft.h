@@ -70,21 +70,21 @@ public:
 		}
 	}
 
-	// freqBinsAccum += (freqBinsDataA * freqBinsDataB) / m_fftSize
+	// freqBinsAccum += (freqBinsDataA * freqBinsDataB) * gain / m_fftSize
 	// All arrays are unordered freq bins data
-	inline void convolve_accum(cplx_f32* freqBinsAccum, cplx_f32* freqBinsDataA, cplx_f32* freqBinsDataB)
+	inline void convolve_accum(cplx_f32* freqBinsAccum, cplx_f32* freqBinsDataA, cplx_f32* freqBinsDataB, float gain = 1.0f)
 	{
 		if (m_freqDataOrdered)
 		{
 			const uint32_t fftSizeFreqDomain = m_fftSize/2 + 1;
 			for (uint32_t i=0; i<fftSizeFreqDomain; i++)
 			{
-				freqBinsAccum[i][0] += (freqBinsDataA[i][0] * freqBinsDataB[i][0] - freqBinsDataA[i][1] * freqBinsDataB[i][1]) / m_fftSize;
-				freqBinsAccum[i][1] += (freqBinsDataA[i][0] * freqBinsDataB[i][1] + freqBinsDataA[i][1] * freqBinsDataB[i][0]) / m_fftSize;
+				freqBinsAccum[i][0] += gain * (freqBinsDataA[i][0] * freqBinsDataB[i][0] - freqBinsDataA[i][1] * freqBinsDataB[i][1]) / m_fftSize;
+				freqBinsAccum[i][1] += gain * (freqBinsDataA[i][0] * freqBinsDataB[i][1] + freqBinsDataA[i][1] * freqBinsDataB[i][0]) / m_fftSize;
 			}
 		}
 		else
-	  		pffft_zconvolve_accumulate(m_setup, (float *) freqBinsDataA, (float *) freqBinsDataB, (float *) freqBinsAccum, 1.0 / m_fftSize);
+	  		pffft_zconvolve_accumulate(m_setup, (float *) freqBinsDataA, (float *) freqBinsDataB, (float *) freqBinsAccum, gain / m_fftSize); // the gain comes for free with pffft's scaling
 	}
 };
 
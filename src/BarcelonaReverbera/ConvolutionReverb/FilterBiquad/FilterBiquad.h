@@ -59,11 +59,32 @@ public:
 	{
 		DEBUG_ASSERT((cutoffFreqTarget >= 20.0f) && (cutoffFreqTarget <= 20000.0f));
 
-		m_cutoffFreq_Current = DspUtils::expSmoothing(cutoffFreqTarget, m_cutoffFreq_Current, smoothingFactor);
+		const float cutoffFreqNext = DspUtils::expSmoothing(cutoffFreqTarget, m_cutoffFreq_Current, smoothingFactor);
+
+		m_cutoffFreq_Current = (cutoffFreqNext == m_cutoffFreq_Current)
+			? cutoffFreqTarget // we have reached a point where diff between target and current is only due to FP precission
+			: cutoffFreqNext;
 
 		computeCoefficientsButterworth2ndOrder(samplerate);
 	}
 
+	inline float getCurrentFreq(void) const
+	{
+		return m_cutoffFreq_Current;
+	}
+
+	inline void getState(double state[kState_Count]) const
+	{
+		for (uint32_t i=0; i<kState_Count; i++)
+			state[i] = m_state[i];
+	}
+
+	inline void setState(const double state[kState_Count])
+	{
+		for (uint32_t i=0; i<kState_Count; i++)
+			m_state[i] = state[i];
+	}
+
 	// Direct Form II transposed (float/double for input/output (depends on template param), but always double for internal processing)
 	template <typename _InOutFpType = float>
 	inline void process(const _InOutFpType* audioInput, _InOutFpType* audioOutput, const uint32_t blockSize)
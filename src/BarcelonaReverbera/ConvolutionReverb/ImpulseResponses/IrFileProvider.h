@@ -0,0 +1,170 @@
+// BarcelonaReverbera - A Non-Uniform Partitioned Convolution Reverb VST3 Plugin
+// Copyright (C) 2024 sbrk devices
+//
+// This file is part of BarcelonaReverbera.
+//
+// BarcelonaReverbera is free software: you can use it and/or modify it for
+// educational and non-commercial purposes only under the terms of the
+// Custom Non-Commercial License.
+//
+// You should have received a copy of the Custom Non-Commercial License
+// along with this program. If not, see https://github.com/SbrkDevices/BarcelonaReverbera.
+//
+// For more information, please contact dani@sbrkdevices.com.
+
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+
+#include <JuceHeader.h>
+
+#include "IrProvider.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// IRs loaded at runtime from the audio files of a folder and its subfolders (WAV, AIFF, FLAC...: the juce_audio_formats basic formats),
+// sorted by path. Mono, stereo and true-stereo (4 channels) files at any samplerate are used. Only their headers are read when the folder is
+// scanned: the samples are decoded when an IR is prepared, straight into the engine's buffers when it is at the engine samplerate (WAV and
+// AIFF files are memory-mapped). Needs the juce_audio_formats module.
+class IrFileProvider : public IrProvider
+{
+private:
+	struct IrFile
+	{
+		juce::File file;
+		juce::String name;
+		int numChannels = 0;
+		double samplerate = 0.0;
+		uint32_t len = 0;
+		uint64_t hash = 0;
+	};
+
+	juce::AudioFormatManager m_formatManager;
+	std::vector<IrFile> m_irFiles;
+
+public:
+	explicit IrFileProvider(const juce::File& folder)
+	{
+		m_formatManager.registerBasicFormats();
+
+		if (!folder.isDirectory())
+			return;
+
+		juce::Array<juce::File> files = folder.findChildFiles(juce::File::findFiles, true, m_formatManager.getWildcardForAllFormats());
+		files.sort();
+
+		for (const juce::File& file : files)
+		{
+			std::unique_ptr<juce::AudioFormatReader> reader(m_formatManager.createReaderFor(file));
+
+			if (reader == nullptr)
+				continue;
+
+			const int numChannels = static_cast<int>(reader->numChannels);
+
+			if (((numChannels != 1) && (numChannels != 2) && (numChannels != 4)) || (reader->sampleRate <= 0.0) || (reader->lengthInSamples <= 0))
+				continue;
+
+			IrFile irFile;
+			irFile.file = file;
+			irFile.name = file.getFileNameWithoutExtension().toUpperCase();
+			irFile.numChannels = numChannels;
+			irFile.samplerate = reader->sampleRate;
+			irFile.len = static_cast<uint32_t>(juce::jmin(reader->lengthInSamples, static_cast<juce::int64>(BCNRVRB_MAX_IR_LEN_SECONDS * reader->sampleRate)));
+
+			// the file identity stands for its content (hashing the samples would mean decoding every file when scanning):
+			const juce::String path = file.getFullPathName();
+			const juce::int64 fileSize = file.getSize();
+			const juce::int64 modificationTime = file.getLastModificationTime().toMilliseconds();
+
+			irFile.hash = hash(path.toRawUTF8(), path.getNumBytesAsUTF8(), 0);
+			irFile.hash = hash(&fileSize, sizeof(fileSize), irFile.hash);
+			irFile.hash = hash(&modificationTime, sizeof(modificationTime), irFile.hash);
+
+			m_irFiles.push_back(irFile);
+		}
+	}
+
+	int getIrCount(void) override
+	{
+		return static_cast<int>(m_irFiles.size());
+	}
+
+	const char* getIrName(int irIndex) override
+	{
+		return isValid(irIndex) ? m_irFiles[irIndex].name.toRawUTF8() : nullptr;
+	}
+
+	int getIrChannelCount(int irIndex) override
+	{
+		return isValid(irIndex) ? m_irFiles[irIndex].numChannels : 0;
+	}
+
+	double getIrSamplerate(int irIndex) override
+	{
+		return isValid(irIndex) ? m_irFiles[irIndex].samplerate : BCNRVRB_DEFAULT_IR_SAMPLERATE;
+	}
+
+	uint32_t getIrLen(int irIndex) override
+	{
+		return isValid(irIndex) ? m_irFiles[irIndex].len : 0;
+	}
+
+	uint64_t getIrHash(int irIndex) override
+	{
+		return isValid(irIndex) ? m_irFiles[irIndex].hash : 0;
+	}
+
+	bool readIr(int irIndex, float* audio[BCNRVRB_MAX_IR_CHANNELS], uint8_t numChannels) override
+	{
+		if (!isValid(irIndex) || (numChannels == 0))
+			return false;
+
+		const IrFile& irFile = m_irFiles[irIndex];
+		std::unique_ptr<juce::AudioFormatReader> reader = createReader(irFile.file);
+
+		if ((reader == nullptr) || (static_cast<int>(reader->numChannels) != irFile.numChannels))
+			return false;
+
+		const int numChannelsRead = juce::jmin(static_cast<int>(numChannels), irFile.numChannels);
+
+		if (!reader->read(audio, numChannelsRead, 0, static_cast<int>(irFile.len)))
+			return false;
+
+		for (int ch=numChannelsRead; ch<numChannels; ch++)
+			memcpy(audio[ch], audio[ch % irFile.numChannels], irFile.len*sizeof(float));
+
+		return true;
+	}
+
+private:
+	inline bool isValid(int irIndex) const
+	{
+		return (irIndex >= 0) && (irIndex < static_cast<int>(m_irFiles.size()));
+	}
+
+	// memory-mapped if the format supports it, so that the samples are decoded straight from the file's pages (no stream buffering)
+	std::unique_ptr<juce::AudioFormatReader> createReader(const juce::File& file)
+	{
+		for (int i=0; i<m_formatManager.getNumKnownFormats(); i++)
+		{
+			juce::AudioFormat* format = m_formatManager.getKnownFormat(i);
+
+			if (!format->canHandleFile(file))
+				continue;
+
+			std::unique_ptr<juce::MemoryMappedAudioFormatReader> mappedReader(format->createMemoryMappedReader(file));
+
+			if ((mappedReader != nullptr) && mappedReader->mapEntireFile())
+				return mappedReader;
+
+			break;
+		}
+
+		return std::unique_ptr<juce::AudioFormatReader>(m_formatManager.createReaderFor(file));
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,217 @@
+// BarcelonaReverbera - A Non-Uniform Partitioned Convolution Reverb VST3 Plugin
+// Copyright (C) 2024 sbrk devices
+//
+// This file is part of BarcelonaReverbera.
+//
+// BarcelonaReverbera is free software: you can use it and/or modify it for
+// educational and non-commercial purposes only under the terms of the
+// Custom Non-Commercial License.
+//
+// You should have received a copy of the Custom Non-Commercial License
+// along with this program. If not, see https://github.com/SbrkDevices/BarcelonaReverbera.
+//
+// For more information, please contact dani@sbrkdevices.com.
+
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+#include <JuceHeader.h>
+
+#include "ConvolutionReverbCommon.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Reader of the IR pack written by ConvertWavsToCArray.py (embedded as the IrPack.bin binary resource), read-only and never copied: an IR is
+// only decoded when it is prepared (see IrBuffersProvider). Layout, all little-endian:
+//  - header: "BRIR", version, IR count, reserved (4 x 4 bytes)
+//  - one entry per IR (kEntrySize bytes): name (kNameSize bytes, zero terminated), channel count, samplerate, length, encoding, step (float:
+//    value of 1 LSB), payload offset (from the start of the pack), payload size, reserved
+//  - the payloads: the IR samples as 24-bit integers, channel after channel, without the zeros the engine appends (see BCNRVRB_IR_EXTRA_ZEROS)
+class IrPack
+{
+public:
+	enum Encoding : uint32_t
+	{
+		kEncoding_Pcm24 = 0, // 3 bytes per sample
+		kEncoding_Pcm24DeltaDeflate = 1, // differences between consecutive samples (modulo 2^24), split into 3 byte planes per channel, then zlib
+	};
+
+	static constexpr uint32_t kVersion = 1;
+	static constexpr uint32_t kHeaderSize = 16;
+	static constexpr uint32_t kNameSize = 128;
+	static constexpr uint32_t kEntrySize = kNameSize + 8*4;
+
+private:
+	struct Entry
+	{
+		const char* name = nullptr;
+		int numChannels = 0;
+		double samplerate = 0.0;
+		uint32_t len = 0;
+		uint32_t encoding = 0;
+		float step = 0.0f;
+		const uint8_t* payload = nullptr;
+		uint32_t payloadSize = 0;
+		const uint8_t* entry = nullptr; // the raw entry (for hashing)
+	};
+
+	std::vector<Entry> m_entries;
+
+public:
+	// an invalid pack has no IRs
+	IrPack(const void* data, size_t size)
+	{
+		const uint8_t* pack = static_cast<const uint8_t*>(data);
+
+		if ((pack == nullptr) || (size < kHeaderSize) || (memcmp(pack, "BRIR", 4) != 0) || (readUint32(pack + 4) != kVersion))
+			return;
+
+		const uint32_t irCount = readUint32(pack + 8);
+
+		if (size < kHeaderSize + size_t(irCount) * kEntrySize)
+			return;
+
+		for (uint32_t i=0; i<irCount; i++)
+		{
+			const uint8_t* raw = pack + kHeaderSize + size_t(i) * kEntrySize;
+			const uint8_t* fields = raw + kNameSize;
+
+			Entry entry;
+			entry.name = reinterpret_cast<const char*>(raw);
+			entry.numChannels = static_cast<int>(readUint32(fields));
+			entry.samplerate = static_cast<double>(readUint32(fields + 4));
+			entry.len = readUint32(fields + 8);
+			entry.encoding = readUint32(fields + 12);
+			memcpy(&entry.step, fields + 16, sizeof(float));
+			entry.payloadSize = readUint32(fields + 24);
+			entry.entry = raw;
+
+			const uint32_t payloadOffset = readUint32(fields + 20);
+			const bool validChannels = (entry.numChannels == 1) || (entry.numChannels == 2) || (entry.numChannels == 4);
+			const bool validEncoding = (entry.encoding == kEncoding_Pcm24) || (entry.encoding == kEncoding_Pcm24DeltaDeflate);
+
+			if ((memchr(raw, 0, kNameSize) == nullptr) || !validChannels || !validEncoding || (entry.samplerate <= 0.0)
+				|| (entry.len == 0) || (size_t(payloadOffset) + entry.payloadSize > size))
+			{
+				DEBUG_ASSERT(false);
+				m_entries.clear();
+				return;
+			}
+
+			entry.payload = pack + payloadOffset;
+
+			m_entries.push_back(entry);
+		}
+	}
+
+	inline int getIrCount(void) const
+	{
+		return static_cast<int>(m_entries.size());
+	}
+
+	inline const char* getIrName(int irIndex) const
+	{
+		return isValid(irIndex) ? m_entries[irIndex].name : nullptr;
+	}
+
+	inline int getIrChannelCount(int irIndex) const
+	{
+		return isValid(irIndex) ? m_entries[irIndex].numChannels : 0;
+	}
+
+	inline double getIrSamplerate(int irIndex) const
+	{
+		return isValid(irIndex) ? m_entries[irIndex].samplerate : BCNRVRB_DEFAULT_IR_SAMPLERATE;
+	}
+
+	inline uint32_t getIrLen(int irIndex) const
+	{
+		return isValid(irIndex) ? m_entries[irIndex].len : 0;
+	}
+
+	// the entry and payload bytes: they hold everything the decoded IR depends on
+	inline void getIrData(int irIndex, const void*& entry, const void*& payload, uint32_t& payloadSize) const
+	{
+		const bool valid = isValid(irIndex);
+
+		entry = valid ? m_entries[irIndex].entry : nullptr;
+		payload = valid ? m_entries[irIndex].payload : nullptr;
+		payloadSize = valid ? m_entries[irIndex].payloadSize : 0;
+	}
+
+	// decodes the first numChannels channels (getIrLen() samples each) into audio. Channels the IR doesn't have are copies of the first ones
+	bool decode(int irIndex, float* audio[BCNRVRB_MAX_IR_CHANNELS], uint8_t numChannels) const
+	{
+		if (!isValid(irIndex) || (numChannels == 0))
+			return false;
+
+		const Entry& entry = m_entries[irIndex];
+		const uint32_t len = entry.len;
+		const size_t channelSize = size_t(len) * 3;
+		const int numChannelsDecoded = juce::jmin(static_cast<int>(numChannels), entry.numChannels);
+
+		if (entry.encoding == kEncoding_Pcm24)
+		{
+			if (entry.payloadSize != channelSize * entry.numChannels)
+				return false;
+
+			for (int ch=0; ch<numChannelsDecoded; ch++)
+			{
+				const uint8_t* bytes = entry.payload + channelSize * ch;
+
+				for (uint32_t i=0; i<len; i++)
+					audio[ch][i] = static_cast<float>(toSigned24(bytes[3*i] | (uint32_t(bytes[3*i + 1]) << 8) | (uint32_t(bytes[3*i + 2]) << 16))) * entry.step;
+			}
+		}
+		else
+		{
+			juce::MemoryInputStream compressed(entry.payload, entry.payloadSize, false);
+			juce::GZIPDecompressorInputStream inflater(compressed);
+			std::vector<uint8_t> planes(channelSize);
+
+			for (int ch=0; ch<numChannelsDecoded; ch++)
+			{
+				if (inflater.read(planes.data(), static_cast<int>(channelSize)) != static_cast<int>(channelSize))
+					return false;
+
+				const uint8_t* plane0 = &planes[0];
+				const uint8_t* plane1 = &planes[len];
+				const uint8_t* plane2 = &planes[2*size_t(len)];
+				uint32_t sample = 0;
+
+				for (uint32_t i=0; i<len; i++)
+				{
+					sample = (sample + (plane0[i] | (uint32_t(plane1[i]) << 8) | (uint32_t(plane2[i]) << 16))) & 0xFFFFFF;
+					audio[ch][i] = static_cast<float>(toSigned24(sample)) * entry.step;
+				}
+			}
+		}
+
+		for (int ch=numChannelsDecoded; ch<numChannels; ch++)
+			memcpy(audio[ch], audio[ch % entry.numChannels], len*sizeof(float));
+
+		return true;
+	}
+
+private:
+	inline bool isValid(int irIndex) const
+	{
+		return (irIndex >= 0) && (irIndex < static_cast<int>(m_entries.size()));
+	}
+
+	static inline uint32_t readUint32(const uint8_t* bytes)
+	{
+		return bytes[0] | (uint32_t(bytes[1]) << 8) | (uint32_t(bytes[2]) << 16) | (uint32_t(bytes[3]) << 24);
+	}
+
+	static inline int32_t toSigned24(uint32_t value)
+	{
+		return static_cast<int32_t>(value << 8) >> 8;
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
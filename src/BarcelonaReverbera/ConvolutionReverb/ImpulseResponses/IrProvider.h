@@ -0,0 +1,139 @@
+// BarcelonaReverbera - A Non-Uniform Partitioned Convolution Reverb VST3 Plugin
+// Copyright (C) 2024 sbrk devices
+//
+// This file is part of BarcelonaReverbera.
+//
+// BarcelonaReverbera is free software: you can use it and/or modify it for
+// educational and non-commercial purposes only under the terms of the
+// Custom Non-Commercial License.
+//
+// You should have received a copy of the Custom Non-Commercial License
+// along with this program. If not, see https://github.com/SbrkDevices/BarcelonaReverbera.
+//
+// For more information, please contact dani@sbrkdevices.com.
+
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <map>
+#include <mutex>
+
+#include "ConvolutionReverbCommon.h"
+#include "IrPack.h"
+#include "IrBuffersAutoGenerated.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// A source of IRs (see IrStore, which indexes the IRs of all the providers one after the other). The IR list is fixed once the provider is
+// built, and every method may be called from any thread
+class IrProvider
+{
+public:
+	virtual ~IrProvider(void) = default;
+
+	virtual int getIrCount(void) = 0;
+	virtual const char* getIrName(int irIndex) = 0;
+
+	// 1 (mono), 2 (stereo) or 4 (true stereo: LL, LR, RL, RR)
+	virtual int getIrChannelCount(int irIndex) = 0;
+	virtual double getIrSamplerate(int irIndex) = 0;
+	virtual uint32_t getIrLen(int irIndex) = 0; // at most BCNRVRB_MAX_IR_LEN_SECONDS
+
+	// identifies the IR content (for the disk cache of prepared IRs): it must change whenever the IR does
+	virtual uint64_t getIrHash(int irIndex) = 0;
+
+	// the IR samples, if the provider keeps them in memory (nullptr otherwise: see readIr())
+	virtual const float* getIrAudioBuffer(int irIndex, int channel)
+	{
+		return nullptr;
+	}
+
+	// decodes the first numChannels channels of the IR (getIrLen() samples each) into audio. Channels the IR doesn't have (mono IRs used in
+	// stereo) are copies of the first ones
+	virtual bool readIr(int irIndex, float* audio[BCNRVRB_MAX_IR_CHANNELS], uint8_t numChannels) = 0;
+
+	// 64-bit FNV-1a, continued from seed (0: a new hash)
+	static inline uint64_t hash(const void* data, size_t size, uint64_t seed)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		uint64_t h = (seed != 0) ? seed : 0xCBF29CE484222325ull;
+
+		for (size_t i=0; i<size; i++)
+		{
+			h ^= bytes[i];
+			h *= 0x100000001B3ull;
+		}
+
+		return h;
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// the IRs embedded in the binary (IrBuffersAutoGenerated.h and its IrPack.bin resource), decoded when they are read
+class IrBuffersProvider : public IrProvider
+{
+private:
+	IrPack m_irPack;
+	std::mutex m_mutex;
+	std::map<int, uint64_t> m_irHashes; // computed on first use
+
+public:
+	IrBuffersProvider(void) : m_irPack(IrBuffers::getIrPackPtr(), IrBuffers::getIrPackSize()) {}
+
+	int getIrCount(void) override
+	{
+		return m_irPack.getIrCount();
+	}
+
+	const char* getIrName(int irIndex) override
+	{
+		return m_irPack.getIrName(irIndex);
+	}
+
+	int getIrChannelCount(int irIndex) override
+	{
+		return m_irPack.getIrChannelCount(irIndex);
+	}
+
+	double getIrSamplerate(int irIndex) override
+	{
+		return m_irPack.getIrSamplerate(irIndex);
+	}
+
+	uint32_t getIrLen(int irIndex) override
+	{
+		return m_irPack.getIrLen(irIndex);
+	}
+
+	uint64_t getIrHash(int irIndex) override
+	{
+		const std::lock_guard<std::mutex> lock(m_mutex);
+
+		const auto it = m_irHashes.find(irIndex);
+
+		if (it != m_irHashes.end())
+			return it->second;
+
+		const void* entry = nullptr;
+		const void* payload = nullptr;
+		uint32_t payloadSize = 0;
+
+		m_irPack.getIrData(irIndex, entry, payload, payloadSize);
+
+		uint64_t irHash = hash(entry, (entry != nullptr) ? IrPack::kEntrySize : 0, 0);
+		irHash = hash(payload, payloadSize, irHash);
+
+		m_irHashes[irIndex] = irHash;
+
+		return irHash;
+	}
+
+	bool readIr(int irIndex, float* audio[BCNRVRB_MAX_IR_CHANNELS], uint8_t numChannels) override
+	{
+		return m_irPack.decode(irIndex, audio, numChannels);
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,416 @@
+#include <vector>
+#include <algorithm>
+
+#include "IrStore.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+std::mutex IrStore::m_mutex;
+std::map<IrStore::Key, std::weak_ptr<IrStore::PreparedIr>> IrStore::m_entries;
+std::map<int, uint32_t> IrStore::m_irAudibleLens;
+juce::File IrStore::m_cacheDirectory;
+bool IrStore::m_cacheDirectorySet = false;
+float IrStore::m_noiseFloorMarginDb = BCNRVRB_IR_NOISE_FLOOR_MARGIN_DB;
+std::unique_ptr<IrProvider> IrStore::m_irProviders[kMaxIrProviders];
+std::atomic<int> IrStore::m_irProviderCount { 0 };
+
+///////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const IrStore::PreparedIr> IrStore::acquire(const Key& key, std::function<void(PreparedIr&)> const & build)
+{
+	std::shared_ptr<PreparedIr> preparedIr;
+
+	{
+		const std::lock_guard<std::mutex> lock(m_mutex);
+
+		for (auto it = m_entries.begin(); it != m_entries.end(); ) // drop the entries no instance is using anymore
+			it = it->second.expired() ? m_entries.erase(it) : std::next(it);
+
+		const auto it = m_entries.find(key);
+
+		if (it != m_entries.end())
+			preparedIr = it->second.lock();
+
+		if (preparedIr == nullptr)
+		{
+			preparedIr = std::make_shared<PreparedIr>();
+			m_entries[key] = preparedIr;
+		}
+	}
+
+	{
+		const std::lock_guard<std::mutex> lock(preparedIr->m_mutex);
+
+		if (!preparedIr->m_ready)
+		{
+			build(*preparedIr);
+			preparedIr->m_ready = true;
+		}
+	}
+
+	return preparedIr;
+}
+
+bool IrStore::loadCached(const Key& key, PreparedIr& preparedIr)
+{
+	CacheFileHeader header;
+	juce::File file;
+
+	if (!getCacheFile(key, preparedIr, preparedIr.arena.getPlannedSize(), header, file) || !file.existsAsFile())
+		return false;
+
+	auto mappedFile = std::make_unique<juce::MemoryMappedFile>(file, juce::MemoryMappedFile::readOnly);
+
+	// a file of another configuration with the same name (hash collision), or truncated, is just prepared again (and overwritten):
+	if ((mappedFile->getData() == nullptr) || (mappedFile->getSize() != kCacheDataOffset + header.dataSize) || (std::memcmp(mappedFile->getData(), &header, sizeof(header)) != 0))
+		return false;
+
+	file.setLastModificationTime(juce::Time::getCurrentTime()); // recently used, see trimCache()
+
+	preparedIr.arena.beginView(static_cast<const uint8_t*>(mappedFile->getData()) + kCacheDataOffset, size_t(header.dataSize));
+	preparedIr.m_mappedFile = std::move(mappedFile);
+
+	return true;
+}
+
+void IrStore::storeCached(const Key& key, const PreparedIr& preparedIr)
+{
+	CacheFileHeader header;
+	juce::File file;
+
+	if (!getCacheFile(key, preparedIr, preparedIr.arena.getSize(), header, file) || (header.dataSize == 0))
+		return;
+
+	const juce::File directory = file.getParentDirectory();
+
+	if (directory.createDirectory().failed())
+		return;
+
+	{
+		// written to a temporary file first, so that other processes never map a partial one
+		juce::TemporaryFile tempFile(file);
+
+		{
+			juce::FileOutputStream stream(tempFile.getFile());
+
+			uint8_t headerData[kCacheDataOffset] = {};
+			std::memcpy(headerData, &header, sizeof(header));
+
+			if (!stream.openedOk() || !stream.write(headerData, kCacheDataOffset) || !stream.write(preparedIr.arena.getMemory(), size_t(header.dataSize)))
+				return;
+
+			stream.flush();
+
+			if (stream.getStatus().failed())
+				return;
+		}
+
+		if (!tempFile.overwriteTargetFileWithTemporary()) // e.g. mapped by another process on Windows: it stays as it is
+			return;
+	}
+
+	trimCache(directory);
+}
+
+void IrStore::setCacheDirectory(const juce::File& directory)
+{
+	const std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_cacheDirectory = directory;
+	m_cacheDirectorySet = true;
+}
+
+void IrStore::setNoiseFloorMargin(float marginDb)
+{
+	const std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_noiseFloorMarginDb = marginDb;
+}
+
+// header of the cache file of an entry, and its path (named after the header hash). Returns false if the disk cache is disabled
+bool IrStore::getCacheFile(const Key& key, const PreparedIr& preparedIr, size_t dataSize, CacheFileHeader& header, juce::File& file)
+{
+	juce::File directory;
+
+	{
+		const std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (!m_cacheDirectorySet)
+		{
+#		  if JUCE_MAC
+			m_cacheDirectory = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory).getChildFile("Caches").getChildFile("BarcelonaReverbera");
+#		  else
+			m_cacheDirectory = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory).getChildFile("BarcelonaReverbera").getChildFile("IrCache");
+#		  endif
+			m_cacheDirectorySet = true;
+		}
+
+		directory = m_cacheDirectory;
+	}
+
+	if (directory == juce::File())
+		return false;
+
+	const uint32_t layout[] = { BCNRVRB_SMALLEST_STAGE_SIZE, BCNRVRB_LONGEST_STAGE_SIZE, BCNRVRB_DIRECT_STAGE_MAX_BLOCK_SIZE, BCNRVRB_MIN_BLOCK_SIZE, BCNRVRB_MAX_BLOCK_SIZE,
+		BCNRVRB_DEFAULT_IR_SAMPLERATE, uint32_t(MemoryArena::m_alignment) }; // entries with freq. domain blocks have a non-zero key.blockSize
+
+	std::memset(&header, 0, sizeof(header)); // no uninitialized padding: the header is hashed and compared as bytes
+	std::memcpy(header.magic, "BCNRVRB", 8);
+	header.version = kCacheVersion;
+	header.numChannels = key.numChannels;
+	int providerIrIndex = key.irIndex;
+	IrProvider* provider = getIrProvider(providerIrIndex);
+
+	if (provider == nullptr)
+		return false;
+
+	header.irContentHash = provider->getIrHash(providerIrIndex);
+	header.layoutHash = IrProvider::hash(layout, sizeof(layout), 0);
+	header.samplerate = key.samplerate;
+	header.blockSize = key.blockSize;
+	header.irLen = preparedIr.irLen;
+	header.irLenWithZeros = preparedIr.irLenWithZeros;
+	header.dataSize = dataSize;
+
+	const uint64_t headerHash = IrProvider::hash(&header, sizeof(header), 0);
+
+	file = directory.getChildFile(juce::String::toHexString(juce::int64(headerHash)).paddedLeft('0', 16) + ".bcnir");
+
+	return true;
+}
+
+// deletes the least recently used cache files, until the cache is below kCacheMaxBytes
+void IrStore::trimCache(const juce::File& directory)
+{
+	juce::Array<juce::File> files = directory.findChildFiles(juce::File::findFiles, false, "*.bcnir");
+
+	int64_t totalBytes = 0;
+
+	for (const juce::File& file : files)
+		totalBytes += file.getSize();
+
+	if (totalBytes <= kCacheMaxBytes)
+		return;
+
+	std::sort(files.begin(), files.end(), [] (const juce::File& a, const juce::File& b) { return a.getLastModificationTime() < b.getLastModificationTime(); });
+
+	for (const juce::File& file : files)
+	{
+		if (totalBytes <= kCacheMaxBytes)
+			break;
+
+		const int64_t fileBytes = file.getSize();
+
+		if (file.deleteFile()) // mapped files can't be deleted on Windows (they are still in use)
+			totalBytes -= fileBytes;
+	}
+}
+
+void IrStore::addIrProvider(std::unique_ptr<IrProvider> provider)
+{
+	const std::lock_guard<std::mutex> lock(m_mutex);
+	const int providerCount = m_irProviderCount.load(std::memory_order_relaxed);
+
+	DEBUG_ASSERT(providerCount < kMaxIrProviders);
+
+	if ((provider == nullptr) || (providerCount >= kMaxIrProviders))
+		return;
+
+	m_irProviders[providerCount] = std::move(provider);
+	m_irProviderCount.store(providerCount + 1, std::memory_order_release);
+}
+
+int IrStore::getIrCount(void)
+{
+	const int providerCount = m_irProviderCount.load(std::memory_order_acquire);
+	int irCount = getIrBuffersProvider().getIrCount();
+
+	for (int i=0; i<providerCount; i++)
+		irCount += m_irProviders[i]->getIrCount();
+
+	return irCount;
+}
+
+const char* IrStore::getIrName(int irIndex)
+{
+	IrProvider* provider = getIrProvider(irIndex);
+
+	return (provider != nullptr) ? provider->getIrName(irIndex) : nullptr;
+}
+
+int IrStore::getIrChannelCount(int irIndex)
+{
+	IrProvider* provider = getIrProvider(irIndex);
+
+	return (provider != nullptr) ? provider->getIrChannelCount(irIndex) : 0;
+}
+
+double IrStore::getIrSamplerate(int irIndex)
+{
+	IrProvider* provider = getIrProvider(irIndex);
+
+	return (provider != nullptr) ? provider->getIrSamplerate(irIndex) : BCNRVRB_DEFAULT_IR_SAMPLERATE;
+}
+
+uint32_t IrStore::getIrLen(int irIndex)
+{
+	IrProvider* provider = getIrProvider(irIndex);
+
+	return (provider != nullptr) ? provider->getIrLen(irIndex) : 0;
+}
+
+uint32_t IrStore::getIrAudibleLen(int irIndex)
+{
+	float marginDb;
+
+	{
+		const std::lock_guard<std::mutex> lock(m_mutex);
+		const auto it = m_irAudibleLens.find(irIndex);
+
+		if (it != m_irAudibleLens.end())
+			return it->second;
+
+		marginDb = m_noiseFloorMarginDb;
+	}
+
+	// analyzed without the lock held, as it may decode the IR (instances racing here just analyze it twice):
+	const uint32_t irLen = getIrLen(irIndex);
+	const int numChannels = getIrChannelCount(irIndex);
+	const float* ir[BCNRVRB_MAX_IR_CHANNELS] = {};
+	std::vector<float> irDecoded;
+
+	for (int ch=0; ch<numChannels; ch++)
+		ir[ch] = getIrAudioBuffer(irIndex, ch);
+
+	if ((numChannels > 0) && (ir[0] == nullptr)) // not in memory: decoded first
+	{
+		float* irDecodedChannels[BCNRVRB_MAX_IR_CHANNELS] = {};
+
+		irDecoded.resize(size_t(irLen) * numChannels);
+
+		for (int ch=0; ch<numChannels; ch++)
+		{
+			irDecodedChannels[ch] = &irDecoded[size_t(irLen) * ch];
+			ir[ch] = irDecodedChannels[ch];
+		}
+
+		if (!readIr(irIndex, irDecodedChannels, uint8_t(numChannels)))
+			return irLen; // left whole (and analyzed again on next use)
+	}
+
+	const uint32_t irAudibleLen = getNoiseFloorLen(ir, numChannels, irLen, getIrSamplerate(irIndex), marginDb);
+
+	const std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_irAudibleLens[irIndex] = irAudibleLen;
+
+	return irAudibleLen;
+}
+
+const float* IrStore::getIrAudioBuffer(int irIndex, int channel)
+{
+	IrProvider* provider = getIrProvider(irIndex);
+
+	return (provider != nullptr) ? provider->getIrAudioBuffer(irIndex, channel) : nullptr;
+}
+
+bool IrStore::readIr(int irIndex, float* audio[BCNRVRB_MAX_IR_CHANNELS], uint8_t numChannels)
+{
+	IrProvider* provider = getIrProvider(irIndex);
+
+	return (provider != nullptr) && provider->readIr(irIndex, audio, numChannels);
+}
+
+// the noise floor is the mean energy of the last 10% of the IR, if it is steady there (otherwise the IR still decays at its end, and is kept
+// whole). Each channel's Schroeder energy decay curve is then followed back from there, 20 ms at a time: the IR decay meets the noise floor
+// where the energy of those 20 ms (the drop of the curve over them) rises marginDb above the floor's
+uint32_t IrStore::getNoiseFloorLen(const float* ir[BCNRVRB_MAX_IR_CHANNELS], int numChannels, uint32_t irLen, double samplerate, float marginDb)
+{
+	const uint32_t windowLen = static_cast<uint32_t>(samplerate * 0.02);
+	const uint32_t fadeLen = static_cast<uint32_t>(samplerate * BCNRVRB_IR_NOISE_FLOOR_FADE_MS / 1000.0);
+	const uint32_t floorLen = irLen / 10;
+	const uint32_t floorStart = irLen - floorLen;
+	const double marginLin = std::pow(10.0, marginDb / 10.0);
+	const double steadyLin = std::pow(10.0, 2.0 / 10.0); // max. level difference between both halves of the floor
+
+	if ((numChannels <= 0) || (windowLen == 0) || (floorLen < 2 * std::max(windowLen, fadeLen))) // too short to tell its floor apart
+		return irLen;
+
+	uint32_t noiseFloorStart = 0;
+
+	for (int ch=0; ch<numChannels; ch++)
+	{
+		const float* irChannel = ir[ch];
+		double floorEnergy[2] = {};
+		double windowEnergy = 0.0;
+
+		for (uint32_t i=floorStart; i<irLen; i++)
+			floorEnergy[(i - floorStart) * 2 / floorLen] += double(irChannel[i]) * irChannel[i];
+
+		if ((floorEnergy[0] <= 0.0) || (floorEnergy[1] <= 0.0) || (floorEnergy[0] > floorEnergy[1] * steadyLin) || (floorEnergy[1] > floorEnergy[0] * steadyLin))
+			return irLen;
+
+		const double windowThreshold = (floorEnergy[0] + floorEnergy[1]) / double(floorLen) * double(windowLen) * marginLin;
+
+		for (uint32_t i=floorStart; i<floorStart+windowLen; i++)
+			windowEnergy += double(irChannel[i]) * irChannel[i];
+
+		uint32_t i = floorStart;
+		bool decayFound = false;
+
+		while ((i > 0) && !decayFound)
+		{
+			const float sampleIn = irChannel[i - 1];
+			const float sampleOut = irChannel[i - 1 + windowLen];
+
+			windowEnergy += double(sampleIn) * sampleIn - double(sampleOut) * sampleOut;
+			i--;
+
+			decayFound = (windowEnergy > windowThreshold); // still decaying: the floor starts after this window
+		}
+
+		if (!decayFound) // no decay into the floor (e.g. a flat envelope): the whole IR is kept
+			return irLen;
+
+		noiseFloorStart = std::max(noiseFloorStart, std::min(i + windowLen, floorStart)); // the latest of all channels
+	}
+
+	return std::min(noiseFloorStart + fadeLen, irLen);
+}
+
+IrProvider* IrStore::getIrProvider(int& irIndex)
+{
+	IrBuffersProvider& irBuffersProvider = getIrBuffersProvider();
+
+	if (irIndex < 0)
+		return nullptr;
+
+	if (irIndex < irBuffersProvider.getIrCount())
+		return &irBuffersProvider;
+
+	irIndex -= irBuffersProvider.getIrCount();
+
+	const int providerCount = m_irProviderCount.load(std::memory_order_acquire);
+
+	for (int i=0; i<providerCount; i++)
+	{
+		const int irCount = m_irProviders[i]->getIrCount();
+
+		if (irIndex < irCount)
+			return m_irProviders[i].get();
+
+		irIndex -= irCount;
+	}
+
+	return nullptr;
+}
+
+// the compiled-in IRs: the pack's index is read on first use
+IrBuffersProvider& IrStore::getIrBuffersProvider(void)
+{
+	static IrBuffersProvider irBuffersProvider;
+
+	return irBuffersProvider;
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <functional>
+
+#include <JuceHeader.h>
+
+#include "ConvolutionReverbCommon.h"
+#include "IrProvider.h"
+#include "MemoryArena.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Process-wide store of prepared IRs (resampled and normalized, plus their freq. domain blocks when the IR is static), shared by all the
+// reverb instances using the same IR with the same configuration. Entries are read-only once built, and are freed when the last instance releases them.
+// Built entries are also written to a disk cache, keyed by the IR content and the configuration: later sessions (and other processes) memory-map
+// them instead of preparing them again.
+class IrStore
+{
+public:
+	struct Key
+	{
+		int irIndex = -1;
+		float samplerate = 0.0f;
+		uint8_t numChannels = 0;
+		uint32_t blockSize = 0; // partition plan of the freq. domain IR blocks (0 if the entry only holds the time-domain IR)
+
+		inline bool operator<(const Key& other) const
+		{
+			return std::tie(irIndex, samplerate, numChannels, blockSize) < std::tie(other.irIndex, other.samplerate, other.numChannels, other.blockSize);
+		}
+	};
+
+	struct PreparedIr
+	{
+		MemoryArena arena; // holds the time-domain IR, followed by the freq. domain IR blocks (if any)
+		const float* ir[BCNRVRB_MAX_IR_CHANNELS] = {}; // resampled and normalized IR (1 channel when mono, 4 when true stereo). Size: irLenWithZeros
+		uint32_t irLen = 0;
+		uint32_t irLenWithZeros = 0;
+
+	private:
+		friend class IrStore;
+
+		std::mutex m_mutex; // held while building
+		bool m_ready = false;
+		std::unique_ptr<juce::MemoryMappedFile> m_mappedFile; // the arena views it when the entry was loaded from the disk cache
+	};
+
+public:
+	// returns the entry for key. If it does not exist yet, build() is called (on the calling thread, once per entry) to fill it in.
+	// Building an entry only blocks the instances waiting for that same entry
+	static std::shared_ptr<const PreparedIr> acquire(const Key& key, std::function<void(PreparedIr&)> const & build);
+
+	// disk cache, used from build(). loadCached() is called between the planning and the allocation passes of the entry's arena (irLen and
+	// irLenWithZeros already set): if the cache holds this entry, the arena is pointed to its memory-mapped data (read-only: nothing must be
+	// written into it) and its allocation pass is started. Otherwise, the entry is built and then written with storeCached()
+	static bool loadCached(const Key& key, PreparedIr& preparedIr);
+	static void storeCached(const Key& key, const PreparedIr& preparedIr);
+
+	// an empty juce::File disables the disk cache. By default, it is in the user's application data (or caches) directory
+	static void setCacheDirectory(const juce::File& directory);
+
+	// IRs are cut where their decay falls to marginDb above their measurement noise floor (BCNRVRB_IR_NOISE_FLOOR_MARGIN_DB by default: a
+	// larger margin cuts them earlier). Like the IR providers, it must be set before any instance uses the IRs (each one is analyzed once)
+	static void setNoiseFloorMargin(float marginDb);
+
+	// the IR library: the compiled-in IRs, followed by the ones of every provider added (in order). Providers must be added before any
+	// instance uses the IRs (e.g. once per process, before the first instance is created), and are kept until the process ends
+	static void addIrProvider(std::unique_ptr<IrProvider> provider);
+	static int getIrCount(void);
+	static const char* getIrName(int irIndex);
+	static int getIrChannelCount(int irIndex);
+	static double getIrSamplerate(int irIndex);
+	static uint32_t getIrLen(int irIndex);
+	// the IR length up to where its decay meets its noise floor, plus a short fade (getIrLen() if it has no noise floor). Analyzed on first use
+	static uint32_t getIrAudibleLen(int irIndex);
+	static const float* getIrAudioBuffer(int irIndex, int channel);
+	static bool readIr(int irIndex, float* audio[BCNRVRB_MAX_IR_CHANNELS], uint8_t numChannels);
+
+private:
+	static constexpr uint32_t kCacheVersion = 2; // must be increased whenever the prepared data changes (resampling, normalization, partitioning...)
+	static constexpr size_t kCacheDataOffset = MemoryArena::m_alignment; // the header is padded, so that the mapped data keeps the arena alignment
+	static constexpr int64_t kCacheMaxBytes = int64_t(1024) * 1024 * 1024; // the least recently used files are deleted above it
+
+	struct CacheFileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t numChannels;
+		uint64_t irContentHash;
+		uint64_t layoutHash; // engine constants which the partitioning depends on
+		float samplerate;
+		uint32_t blockSize;
+		uint32_t irLen;
+		uint32_t irLenWithZeros;
+		uint64_t dataSize; // arena size
+	};
+
+	static_assert(sizeof(CacheFileHeader) <= kCacheDataOffset, "cache file header too long");
+
+	static constexpr int kMaxIrProviders = 8;
+
+	static bool getCacheFile(const Key& key, const PreparedIr& preparedIr, size_t dataSize, CacheFileHeader& header, juce::File& file);
+	static void trimCache(const juce::File& directory);
+	static uint32_t getNoiseFloorLen(const float* ir[BCNRVRB_MAX_IR_CHANNELS], int numChannels, uint32_t irLen, double samplerate, float marginDb);
+	static IrProvider* getIrProvider(int& irIndex); // irIndex: in, the library index; out, the provider's
+	static IrBuffersProvider& getIrBuffersProvider(void);
+
+	static std::mutex m_mutex;
+	static std::map<Key, std::weak_ptr<PreparedIr>> m_entries;
+	static std::map<int, uint32_t> m_irAudibleLens; // see getIrAudibleLen()
+	static juce::File m_cacheDirectory;
+	static bool m_cacheDirectorySet;
+	static float m_noiseFloorMarginDb; // see setNoiseFloorMargin()
+	static std::unique_ptr<IrProvider> m_irProviders[kMaxIrProviders]; // besides the compiled-in IRs
+	static std::atomic<int> m_irProviderCount;
+};
+
+///////////////////////////////////////////////////////////////////////////////
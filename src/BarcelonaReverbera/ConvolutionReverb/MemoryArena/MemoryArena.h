@@ -0,0 +1,137 @@
+#pragma once
+
+#include "ConvolutionReverbCommon.h"
+#include "pffft.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Single memory block holding all the buffers of a reverb instance, sized to what the current configuration needs.
+// It is used in 2 passes with the same sequence of allocate() calls:
+//   1) planning pass (after beginPlan()): nothing is allocated, nullptr is returned and only the total size is measured.
+//   2) allocation pass (after commit()): the returned pointers point into the (zeroed) memory block.
+// An arena can also walk the memory block of another one (beginView()), to get the same pointers without owning (nor zeroing) the memory.
+class MemoryArena
+{
+public:
+	static constexpr size_t m_alignment = 64; // every buffer starts on its own cache line (also enough for SIMD)
+
+private:
+	uint8_t* m_memory = nullptr;
+	size_t m_size = 0; // size of m_memory, in bytes
+	size_t m_offset = 0; // bytes planned/allocated so far in the current pass
+	bool m_planning = true;
+	bool m_view = false; // m_memory belongs to another arena
+
+public:
+	MemoryArena(void) = default;
+	MemoryArena(const MemoryArena&) = delete;
+	MemoryArena& operator=(const MemoryArena&) = delete;
+
+	~MemoryArena(void)
+	{
+		release();
+	}
+
+	inline void beginPlan(void)
+	{
+		m_planning = true;
+		m_offset = 0;
+	}
+
+	// allocates exactly the planned size (the memory block is only reallocated if the size has changed), and starts the allocation pass
+	inline void commit(void)
+	{
+		DEBUG_ASSERT(m_planning);
+
+		const size_t size = m_offset;
+
+		if ((size != m_size) || m_view)
+		{
+			release();
+
+			if (size > 0)
+			{
+				m_memory = (uint8_t*) pffft_aligned_malloc(size);
+				DEBUG_ASSERT(m_memory != nullptr);
+			}
+
+			m_size = (m_memory != nullptr) ? size : 0;
+		}
+
+		if (m_memory != nullptr)
+			std::memset(m_memory, 0, m_size);
+
+		m_planning = false;
+		m_offset = 0;
+	}
+
+	// starts an allocation pass over the memory block of other, which must have been committed with the same allocation sequence
+	inline void beginView(const MemoryArena& other)
+	{
+		DEBUG_ASSERT(!other.m_planning);
+
+		release();
+
+		m_memory = other.m_memory;
+		m_size = other.m_size;
+		m_view = true;
+		m_planning = false;
+		m_offset = 0;
+	}
+
+	// starts an allocation pass over an external memory block (e.g. a memory-mapped file) holding the same allocation sequence, which is not freed
+	inline void beginView(const void* memory, size_t size)
+	{
+		release();
+
+		m_memory = (uint8_t*) memory;
+		m_size = size;
+		m_view = true;
+		m_planning = false;
+		m_offset = 0;
+	}
+
+	template <typename T>
+	inline T* allocate(size_t count)
+	{
+		const size_t offset = m_offset;
+
+		m_offset += ((count * sizeof(T) + m_alignment - 1) / m_alignment) * m_alignment;
+
+		if (m_planning || (count == 0))
+			return nullptr;
+
+		DEBUG_ASSERT(m_offset <= m_size); // allocation pass must match the planning pass
+
+		return (m_offset <= m_size) ? reinterpret_cast<T*>(m_memory + offset) : nullptr;
+	}
+
+	inline size_t getSize(void) const
+	{
+		return m_size;
+	}
+
+	// size the planning pass has reached so far
+	inline size_t getPlannedSize(void) const
+	{
+		DEBUG_ASSERT(m_planning);
+		return m_offset;
+	}
+
+	inline const uint8_t* getMemory(void) const
+	{
+		return m_memory;
+	}
+
+	inline void release(void)
+	{
+		if ((m_memory != nullptr) && !m_view)
+			pffft_aligned_free(m_memory);
+
+		m_memory = nullptr;
+		m_size = 0;
+		m_view = false;
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
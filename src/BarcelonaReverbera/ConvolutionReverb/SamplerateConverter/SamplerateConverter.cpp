@@ -1,64 +1,320 @@
 #include "SamplerateConverter.h"
-#include <JuceHeader.h>
+
+#include <algorithm>
+#include <numeric>
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#	define SAMPLERATE_CONVERTER_X86				(1)
+#	include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#	define SAMPLERATE_CONVERTER_NEON			(1)
+#	include <arm_neon.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+std::mutex SamplerateConverter::m_mutex;
+std::map<std::pair<uint32_t, uint32_t>, std::shared_ptr<const SamplerateConverter::FilterBank>> SamplerateConverter::m_filterBanks;
 
 ///////////////////////////////////////////////////////////////////////////////
 
-class ResamplingAudioSource : public juce::AudioSource
+uint32_t SamplerateConverter::getOutputLength(double samplerateIn, double samplerateOut, uint32_t audioInLength, uint32_t audioOutLengthMax)
+{
+	DEBUG_ASSERT(samplerateOut > 0.0);
+
+    const double samplerateRatioOutToIn = samplerateOut / samplerateIn;
+
+	const uint32_t audioOutLength = static_cast<uint32_t>(std::ceil(audioInLength * samplerateRatioOutToIn));
+
+	return (audioOutLength > audioOutLengthMax) ? audioOutLengthMax : audioOutLength;
+}
+
+void SamplerateConverter::convert(double samplerateIn, double samplerateOut, uint8_t numChannels, const float* audioIn[BCNRVRB_MAX_IR_CHANNELS], float* audioOut[BCNRVRB_MAX_IR_CHANNELS], uint32_t audioInLength, uint32_t audioOutLengthMax, uint32_t& audioOutLengthActual)
 {
-public:
-    ResamplingAudioSource(const float* sourceAudio, uint32_t numSamples)
-		: m_sourceAudio(sourceAudio), m_numSamples(numSamples) {}
+	DEBUG_ASSERT(samplerateIn > 0.0);
+	DEBUG_ASSERT(samplerateOut > 0.0);
+	DEBUG_ASSERT(numChannels <= BCNRVRB_MAX_IR_CHANNELS);
+
+	audioOutLengthActual = getOutputLength(samplerateIn, samplerateOut, audioInLength, audioOutLengthMax);
+
+	for (int ch=0; ch<numChannels; ch++)
+	{
+		DEBUG_ASSERT(audioIn[ch] != nullptr);
+		DEBUG_ASSERT(audioOut[ch] != nullptr);
+	}
+
+	if ((audioOutLengthActual == 0) || (numChannels == 0))
+		return;
+
+	const std::shared_ptr<const FilterBank> bank = getFilterBank(samplerateIn, samplerateOut);
+
+	if (bank->numPhases == bank->decimation) // same samplerate
+	{
+		for (int ch=0; ch<numChannels; ch++)
+		{
+			const uint32_t len = std::min(audioInLength, audioOutLengthActual);
 
-    void prepareToPlay(int samplesPerBlockExpected, double sampleRate) override {}
+			memcpy(audioOut[ch], audioIn[ch], len*sizeof(float));
+			memset(audioOut[ch] + len, 0, (audioOutLengthActual - len)*sizeof(float));
+		}
 
-    void releaseResources() override {}
+		return;
+	}
+
+	// zero-padded copy of the input, so that no output sample needs bounds checks (the last ones may read past the input, when the ratio is approximated)
+	const uint32_t numTaps = bank->numTaps;
+	const uint32_t lastInputIndex = static_cast<uint32_t>((uint64_t(audioOutLengthActual - 1) * bank->decimation) / bank->numPhases);
+	const uint32_t paddedLen = std::max(audioInLength, lastInputIndex + 1) + numTaps;
+
+	std::vector<float> padded(size_t(paddedLen) * numChannels, 0.0f);
+
+	Args args;
+	args.bank = bank.get();
+
+	for (int ch=0; ch<numChannels; ch++)
+	{
+		float* in = &padded[size_t(paddedLen) * ch];
 
-    void getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill) override
-    {
-        bufferToFill.clearActiveBufferRegion();
+		memcpy(in + numTaps/2 - 1, audioIn[ch], audioInLength*sizeof(float));
 
-        const int numSamples = std::min(bufferToFill.numSamples, m_numSamples - m_currentSample);
+		args.in[ch] = in;
+		args.out[ch] = audioOut[ch];
+	}
+
+	// long outputs (IRs at high samplerates) are split across threads, the calling one doing the last part
+	const uint32_t numThreads = std::max(1u, std::min(std::max(1u, std::thread::hardware_concurrency()), audioOutLengthActual / kMinOutputSamplesPerThread));
+	const uint32_t samplesPerThread = (audioOutLengthActual + numThreads - 1) / numThreads;
+
+	std::vector<std::thread> threads;
+	threads.reserve(numThreads - 1);
 
-		bufferToFill.buffer->copyFrom(0, bufferToFill.startSample, &m_sourceAudio[m_currentSample], numSamples);
+	for (uint32_t t=0; t<numThreads; t++)
+	{
+		Args threadArgs = args;
+		threadArgs.start = t * samplesPerThread;
+		threadArgs.end = std::min(audioOutLengthActual, threadArgs.start + samplesPerThread);
 
-        m_currentSample += numSamples;
-    }
+		if (t + 1 < numThreads)
+			threads.emplace_back([threadArgs, numChannels] () { process(threadArgs, numChannels); });
+		else
+			process(threadArgs, numChannels);
+	}
 
-private:
-    const float* m_sourceAudio;
-    int m_numSamples;
-    int m_currentSample = 0;
-};
+	for (std::thread& thread : threads)
+		thread.join();
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 
-void SamplerateConverter::convert(double samplerateIn, double samplerateOut, const float* audioIn[2], float* audioOut[2], uint32_t audioInLength, uint32_t audioOutLengthMax, uint32_t& audioOutLengthActual)
+std::shared_ptr<const SamplerateConverter::FilterBank> SamplerateConverter::getFilterBank(double samplerateIn, double samplerateOut)
 {
-	DEBUG_ASSERT(samplerateOut > 0.0);
+	// ratio L/M: exact when both samplerates are integers and it reduces to at most kMaxPhases phases
+	uint64_t numPhases = static_cast<uint64_t>(std::llround(samplerateOut));
+	uint64_t decimation = static_cast<uint64_t>(std::llround(samplerateIn));
 
-    const double samplerateRatioOutToIn = samplerateOut / samplerateIn;
-	const double samplesInPerOutputSample = samplerateIn / samplerateOut;
+	if ((double(numPhases) == samplerateOut) && (double(decimation) == samplerateIn) && (numPhases > 0) && (decimation > 0))
+	{
+		const uint64_t divisor = std::gcd(numPhases, decimation);
+		numPhases /= divisor;
+		decimation /= divisor;
+	}
+	else
+	{
+		numPhases = 0;
+	}
 
-	audioOutLengthActual = static_cast<uint32_t>(std::ceil(audioInLength * samplerateRatioOutToIn));
+	if ((numPhases == 0) || (numPhases > kMaxPhases))
+	{
+		numPhases = kMaxPhases;
+		decimation = std::max<uint64_t>(1, static_cast<uint64_t>(std::llround(kMaxPhases * samplerateIn / samplerateOut)));
+	}
+
+	const std::pair<uint32_t, uint32_t> key(static_cast<uint32_t>(numPhases), static_cast<uint32_t>(decimation));
 
-	if (audioOutLengthActual > audioOutLengthMax)
-		audioOutLengthActual = audioOutLengthMax;
+	const std::lock_guard<std::mutex> lock(m_mutex); // held while building (a few ms, once per ratio)
 
-	for (int ch=0; ch<2; ch++)
+	std::shared_ptr<const FilterBank>& entry = m_filterBanks[key];
+
+	if (entry == nullptr)
 	{
-		DEBUG_ASSERT(audioIn[ch] != nullptr);
-		DEBUG_ASSERT(audioOut[ch] != nullptr);
+		auto bank = std::make_shared<FilterBank>();
+		bank->numPhases = key.first;
+		bank->decimation = key.second;
 
-		ResamplingAudioSource sourceAudio(audioIn[ch], audioInLength);
-    	juce::ResamplingAudioSource resampler(&sourceAudio, false, 1);
+		buildFilterBank(*bank);
 
-    	resampler.setResamplingRatio(samplesInPerOutputSample);
-    	resampler.prepareToPlay(audioInLength, samplerateOut);
+		entry = bank;
+	}
+
+	return entry;
+}
+
+void SamplerateConverter::buildFilterBank(FilterBank& bank)
+{
+	const uint32_t numPhases = bank.numPhases;
+
+	if (numPhases == bank.decimation)
+	{
+		bank.numTaps = 0;
+		return;
+	}
+
+	// cutoff, in input samplerate units (1.0: input Nyquist frequency). When downsampling, the output Nyquist frequency is lower
+	const double cutoff = kPassband * std::min(1.0, double(numPhases) / double(bank.decimation));
+
+	const uint32_t halfLen = static_cast<uint32_t>(std::ceil(kZeroCrossings / cutoff));
+	const uint32_t numTaps = ((2*halfLen + kTapMultiple - 1) / kTapMultiple) * kTapMultiple;
+	const double halfWidth = 0.5 * numTaps;
+
+	bank.numTaps = numTaps;
+	bank.taps.resize(size_t(numPhases) * numTaps);
+
+	// zeroth-order modified Bessel function of the first kind (Kaiser window)
+	auto besselI0 = [] (double x)
+	{
+		double sum = 1.0;
+		double term = 1.0;
+
+		for (int k=1; k<64; k++)
+		{
+			const double t = x / (2.0 * k);
+			term *= t*t;
+			sum += term;
+
+			if (term < sum * 1.0e-17)
+				break;
+		}
+
+		return sum;
+	};
+
+	const double windowNorm = 1.0 / besselI0(kKaiserBeta);
+
+	for (uint32_t p=0; p<numPhases; p++)
+	{
+		float* taps = &bank.taps[size_t(p) * numTaps];
+		double sum = 0.0;
+
+		for (uint32_t k=0; k<numTaps; k++)
+		{
+			const double t = double(p) / numPhases + halfWidth - 1.0 - k; // output time - input time, in input samples
+			const double x = t / halfWidth;
+
+			const double window = (std::abs(x) < 1.0) ? besselI0(kKaiserBeta * std::sqrt(1.0 - x*x)) * windowNorm : 0.0;
+			const double sinc = (t == 0.0) ? 1.0 : std::sin(M_PI * cutoff * t) / (M_PI * cutoff * t);
+
+			const double tap = cutoff * sinc * window;
+
+			taps[k] = static_cast<float>(tap);
+			sum += tap;
+		}
+
+		// unity DC gain on every phase (no ripple at the output samplerate)
+		const float gain = static_cast<float>(1.0 / sum);
 
-		juce::AudioBuffer<float> resampledBuffer(&audioOut[ch], 1, audioOutLengthActual);
-    	juce::AudioSourceChannelInfo resampledInfo(&resampledBuffer, 0, resampledBuffer.getNumSamples());
+		for (uint32_t k=0; k<numTaps; k++)
+			taps[k] *= gain;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// dot products of one filter phase with every channel's input, 8 taps per iteration (SSE/NEON: 2 vectors)
+template<uint8_t NumChannels>
+void SamplerateConverter::process(const Args& args)
+{
+	const FilterBank& bank = *args.bank;
+	const uint32_t numTaps = bank.numTaps;
+	const uint64_t numPhases = bank.numPhases;
+	const uint64_t decimation = bank.decimation;
+
+	for (uint32_t n=args.start; n<args.end; n++)
+	{
+		const uint64_t pos = uint64_t(n) * decimation;
+		const uint32_t inIndex = static_cast<uint32_t>(pos / numPhases); // first tap: padded input sample inIndex (input sample inIndex - numTaps/2 + 1)
+		const float* taps = &bank.taps[size_t(pos % numPhases) * numTaps];
+
+#	  if SAMPLERATE_CONVERTER_X86
+		__m128 acc[NumChannels];
+
+		for (int ch=0; ch<NumChannels; ch++)
+			acc[ch] = _mm_setzero_ps();
+
+		for (uint32_t k=0; k<numTaps; k+=8)
+		{
+			const __m128 h0 = _mm_loadu_ps(taps + k);
+			const __m128 h1 = _mm_loadu_ps(taps + k + 4);
+
+			for (int ch=0; ch<NumChannels; ch++)
+			{
+				const float* in = args.in[ch] + inIndex + k;
+				acc[ch] = _mm_add_ps(acc[ch], _mm_add_ps(_mm_mul_ps(h0, _mm_loadu_ps(in)), _mm_mul_ps(h1, _mm_loadu_ps(in + 4))));
+			}
+		}
+
+		for (int ch=0; ch<NumChannels; ch++)
+		{
+			const __m128 sum2 = _mm_add_ps(acc[ch], _mm_movehl_ps(acc[ch], acc[ch]));
+			args.out[ch][n] = _mm_cvtss_f32(_mm_add_ss(sum2, _mm_shuffle_ps(sum2, sum2, 1)));
+		}
+#	  elif SAMPLERATE_CONVERTER_NEON
+		float32x4_t acc[NumChannels];
+
+		for (int ch=0; ch<NumChannels; ch++)
+			acc[ch] = vdupq_n_f32(0.0f);
+
+		for (uint32_t k=0; k<numTaps; k+=8)
+		{
+			const float32x4_t h0 = vld1q_f32(taps + k);
+			const float32x4_t h1 = vld1q_f32(taps + k + 4);
+
+			for (int ch=0; ch<NumChannels; ch++)
+			{
+				const float* in = args.in[ch] + inIndex + k;
+				acc[ch] = vmlaq_f32(vmlaq_f32(acc[ch], h0, vld1q_f32(in)), h1, vld1q_f32(in + 4));
+			}
+		}
+
+		for (int ch=0; ch<NumChannels; ch++)
+		{
+			const float32x2_t sum2 = vadd_f32(vget_low_f32(acc[ch]), vget_high_f32(acc[ch]));
+			args.out[ch][n] = vget_lane_f32(vpadd_f32(sum2, sum2), 0);
+		}
+#	  else
+		float acc[NumChannels] = {};
+
+		for (uint32_t k=0; k<numTaps; k++)
+		{
+			for (int ch=0; ch<NumChannels; ch++)
+				acc[ch] += taps[k] * args.in[ch][inIndex + k];
+		}
+
+		for (int ch=0; ch<NumChannels; ch++)
+			args.out[ch][n] = acc[ch];
+#	  endif
+	}
+}
+
+void SamplerateConverter::process(const Args& args, uint8_t numChannels)
+{
+	switch (numChannels)
+	{
+		case 1: process<1>(args); break;
+		case 2: process<2>(args); break;
+		case 4: process<4>(args); break;
+		default:
+		{
+			for (int ch=0; ch<numChannels; ch++)
+			{
+				Args channelArgs = args;
+				channelArgs.in[0] = args.in[ch];
+				channelArgs.out[0] = args.out[ch];
 
-    	resampler.getNextAudioBlock(resampledInfo);
+				process<1>(channelArgs);
+			}
+			break;
+		}
 	}
 }
 
@@ -2,12 +2,58 @@
 
 #include "ConvolutionReverbCommon.h"
 
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
 ///////////////////////////////////////////////////////////////////////////////
 
+// Polyphase windowed-sinc (Kaiser) resampler. The ratio is taken as a fraction L/M (output/input samplerates, reduced), and output sample n is
+// the dot product of phase (n*M)%L of the filter bank with the input around sample (n*M)/L. Filter banks are built on first use of each ratio and
+// kept for the whole process (48 kHz to 44.1/88.2/96/192 kHz have 147/160, 147/80, 2/1 and 4/1 phases). All the channels are processed in
+// the same pass over the taps, and long outputs are split across threads.
 class SamplerateConverter
 {
 public:
-	static void convert(double samplerateIn, double samplerateOut, const float* audioIn[2], float* audioOut[2], uint32_t audioInLength, uint32_t audioOutLengthMax, uint32_t& audioOutLengthActual);
+	static uint32_t getOutputLength(double samplerateIn, double samplerateOut, uint32_t audioInLength, uint32_t audioOutLengthMax);
+	static void convert(double samplerateIn, double samplerateOut, uint8_t numChannels, const float* audioIn[BCNRVRB_MAX_IR_CHANNELS], float* audioOut[BCNRVRB_MAX_IR_CHANNELS], uint32_t audioInLength, uint32_t audioOutLengthMax, uint32_t& audioOutLengthActual);
+
+private:
+	static constexpr uint32_t kMaxPhases = 1024; // ratios which don't reduce below this are approximated (tiny pitch error: < 1/(2*kMaxPhases) of the ratio)
+	static constexpr uint32_t kZeroCrossings = 24; // per side, at the filter cutoff
+	static constexpr uint32_t kTapMultiple = 8;
+	static constexpr double kPassband = 0.95; // cutoff, relative to the lower Nyquist frequency
+	static constexpr double kKaiserBeta = 9.0; // ~90 dB stopband attenuation
+	static constexpr uint32_t kMinOutputSamplesPerThread = 64 * 1024;
+
+	struct FilterBank
+	{
+		uint32_t numPhases = 0; // L
+		uint32_t decimation = 0; // M
+		uint32_t numTaps = 0; // per phase, multiple of kTapMultiple
+		std::vector<float> taps; // numPhases * numTaps. Phase p, tap k: h(p/L + numTaps/2 - 1 - k), in input samples
+	};
+
+	struct Args
+	{
+		const FilterBank* bank = nullptr;
+		const float* in[BCNRVRB_MAX_IR_CHANNELS] = {}; // zero-padded: numTaps/2 - 1 samples before the input, numTaps after it
+		float* out[BCNRVRB_MAX_IR_CHANNELS] = {};
+		uint32_t start = 0; // output samples [start, end)
+		uint32_t end = 0;
+	};
+
+	static std::shared_ptr<const FilterBank> getFilterBank(double samplerateIn, double samplerateOut);
+	static void buildFilterBank(FilterBank& bank);
+
+	template<uint8_t NumChannels>
+	static void process(const Args& args);
+	static void process(const Args& args, uint8_t numChannels);
+
+	static std::mutex m_mutex;
+	static std::map<std::pair<uint32_t, uint32_t>, std::shared_ptr<const FilterBank>> m_filterBanks;
 };
 
-///////////////////////////////////////////////////////////////////////////////
\ No newline at end of file
+///////////////////////////////////////////////////////////////////////////////
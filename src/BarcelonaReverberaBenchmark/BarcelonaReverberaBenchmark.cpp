@@ -0,0 +1,589 @@
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+#include "ConvolutionReverb.h"
+#include "Benchmark.h"
+#include "SyntheticIr.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define BENCHMARK_IR_LEN_SECONDS			(2.0) // for the component benchmarks (the reverb ones use the length of the first compiled-in IR)
+#define BENCHMARK_IR_RT60_SECONDS			(1.5)
+#define BENCHMARK_NUM_CHANNELS				(2)
+#define BENCHMARK_FILTER_BLOCK_SIZE			(1024)
+#define BENCHMARK_REVERB_BLOCK_SIZE			(512)
+#define BENCHMARK_CALLBACK_BLOCK_SIZE		(128) // process() benchmarks, run in real time
+#define BENCHMARK_CALLBACK_WARMUP_SECONDS	(2.0) // until the first IR update (spread over many calls when time-sliced) is done
+
+///////////////////////////////////////////////////////////////////////////////
+
+// a synthetic IR with BCNRVRB_MAX_IR_CHANNELS channels (the stereo benchmarks use the first 2), zero padded as the engine expects (see ConvolutionEngine::getIrLenPadded())
+struct BenchmarkIr
+{
+	MemoryArena arena;
+	float* ir[BCNRVRB_MAX_IR_CHANNELS] = {};
+	uint32_t irLen = 0;
+	uint32_t irLenPadded = 0;
+
+	BenchmarkIr(double samplerate, uint32_t len) : irLen(len), irLenPadded(ConvolutionEngine::getIrLenPadded(len))
+	{
+		arena.beginPlan();
+		allocate();
+		arena.commit();
+		allocate();
+
+		for (uint32_t ch=0; ch<BCNRVRB_MAX_IR_CHANNELS; ch++)
+			SyntheticIr::generate(ir[ch], irLen, samplerate, BENCHMARK_IR_RT60_SECONDS, 1 + ch);
+	}
+
+	void allocate(void)
+	{
+		for (uint32_t ch=0; ch<BCNRVRB_MAX_IR_CHANNELS; ch++)
+			ir[ch] = arena.allocate<float>(irLenPadded);
+	}
+};
+
+// stereo audio buffers filled with noise (input) and zeros (output)
+struct BenchmarkAudio
+{
+	MemoryArena arena;
+	float* in[2] = { nullptr, nullptr };
+	float* out[2] = { nullptr, nullptr };
+
+	BenchmarkAudio(uint32_t len)
+	{
+		arena.beginPlan();
+		allocate(len);
+		arena.commit();
+		allocate(len);
+
+		for (uint32_t ch=0; ch<2; ch++)
+			SyntheticIr::generate(in[ch], len, 48000.0, 1.0e6, 100 + ch); // ~flat white noise
+	}
+
+	void allocate(uint32_t len)
+	{
+		for (uint32_t ch=0; ch<2; ch++)
+		{
+			in[ch] = arena.allocate<float>(len);
+			out[ch] = arena.allocate<float>(len);
+		}
+	}
+
+	const float** getIn(void)
+	{
+		m_in[0] = in[0];
+		m_in[1] = in[1];
+		return m_in;
+	}
+
+private:
+	const float* m_in[2] = { nullptr, nullptr };
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Fft<>::process() and convolve_accum(), as used by the FFT stages (unordered freq. bins), at every stage size
+static void benchmarkFft(Benchmark& bench)
+{
+	for (uint32_t blockSize=BCNRVRB_SMALLEST_STAGE_SIZE; blockSize<=BCNRVRB_LONGEST_STAGE_SIZE; blockSize*=2)
+	{
+		const uint32_t fftSize = GET_FFT_SIZE_TIME_DOMAIN(blockSize);
+		const uint32_t freqBufSize = GET_NEXT_MULTIPLE_OF_4(GET_FFT_SIZE_FREQ_DOMAIN(blockSize));
+
+		MemoryArena arena;
+		float* timeData = nullptr;
+		float* work = nullptr;
+		cplx_f32* freqA = nullptr;
+		cplx_f32* freqB = nullptr;
+		cplx_f32* freqAccum = nullptr;
+
+		auto allocate = [&] ()
+		{
+			timeData = arena.allocate<float>(fftSize);
+			work = arena.allocate<float>(fftSize);
+			freqA = arena.allocate<cplx_f32>(freqBufSize);
+			freqB = arena.allocate<cplx_f32>(freqBufSize);
+			freqAccum = arena.allocate<cplx_f32>(freqBufSize);
+		};
+
+		arena.beginPlan();
+		allocate();
+		arena.commit();
+		allocate();
+
+		SyntheticIr::generate(timeData, blockSize, bench.getSamplerate(), 1.0e6, blockSize); // 2nd half stays zero padded, as in the stages
+
+		Fft<true, false> fft;
+		Fft<false, false> ifft;
+		fft.init(fftSize, work);
+		ifft.init(fftSize, work);
+
+		fft.process(timeData, freqA);
+		fft.process(timeData, freqB);
+
+		bench.run("Fft::process", "forward", blockSize, blockSize, [&] () { fft.process(timeData, freqA); });
+		bench.run("Fft::process", "inverse", blockSize, blockSize, [&] () { ifft.process(timeData, freqB); });
+		bench.run("Fft::convolve_accum", "", blockSize, blockSize, [&] () { ifft.convolve_accum(freqAccum, freqA, freqA, 1.0e-6f); }); // small gain: the accumulator must not grow to inf
+
+		fft.exit();
+		ifft.exit();
+	}
+}
+
+// numIrChannels: BENCHMARK_NUM_CHANNELS, or 4 (true stereo). numInputChannels: BENCHMARK_NUM_CHANNELS, or 1 (mono input)
+static void benchmarkDirectStage(Benchmark& bench, const BenchmarkIr& ir, uint8_t numIrChannels, uint8_t numInputChannels, const char* variant)
+{
+	for (uint32_t blockSize=BCNRVRB_MIN_BLOCK_SIZE; blockSize<=BCNRVRB_DIRECT_STAGE_MAX_BLOCK_SIZE; blockSize*=2)
+	{
+		const uint32_t directStageBlockSize = ConvolutionEngine::getDirectStageBlockSize(blockSize);
+
+		MemoryArena arena;
+		BenchmarkAudio audio(blockSize);
+		auto stage = std::make_unique<ConvolutionEngineDirectStage<BCNRVRB_DIRECT_STAGE_MAX_BLOCK_SIZE>>();
+
+		arena.beginPlan();
+		stage->allocateBuffers(arena, blockSize, directStageBlockSize, numInputChannels);
+		arena.commit();
+		stage->allocateBuffers(arena, blockSize, directStageBlockSize, numInputChannels);
+
+		stage->init(blockSize, directStageBlockSize, BENCHMARK_NUM_CHANNELS, numInputChannels, numIrChannels, ir.ir, nullptr);
+
+		const float** in = audio.getIn();
+		bench.run("ConvolutionEngineDirectStage::process", variant, blockSize, blockSize, [&] () { stage->process(in, audio.out, false); });
+
+		stage->exit();
+	}
+}
+
+// every direct stage FIR kernel this CPU supports, on its own (ConvolutionEngineDirectStage uses the fastest one)
+static void benchmarkDirectStageKernels(Benchmark& bench, const BenchmarkIr& ir)
+{
+	for (uint32_t blockSize=BCNRVRB_MIN_BLOCK_SIZE; blockSize<=BCNRVRB_DIRECT_STAGE_MAX_BLOCK_SIZE; blockSize*=2)
+	{
+		const uint32_t numTaps = 2 * ConvolutionEngine::getDirectStageBlockSize(blockSize);
+
+		BenchmarkAudio history(blockSize + numTaps); // same layout as the direct stage's (reversed input)
+		BenchmarkAudio audio(blockSize);
+
+		DirectStageKernels::Args args;
+
+		for (uint32_t ch=0; ch<BCNRVRB_MAX_IR_CHANNELS; ch++)
+			args.ir[ch] = ir.ir[ch];
+
+		for (uint32_t ch=0; ch<2; ch++)
+		{
+			args.history[ch] = history.in[ch];
+			args.out[ch] = audio.out[ch];
+		}
+
+		args.numSamples = blockSize;
+		args.numTaps = numTaps;
+		args.gain = 1.0e-6f; // the outputs must not grow to inf
+
+		auto run = [&] (const std::string& variant, DirectStageKernels::Kernel stereoKernel, DirectStageKernels::Kernel trueStereoKernel)
+		{
+			bench.run("DirectStageKernels", variant, blockSize, blockSize, [&] () { stereoKernel(args); });
+			bench.run("DirectStageKernels", variant + "_true_stereo", blockSize, blockSize, [&] () { trueStereoKernel(args); });
+		};
+
+		run("scalar", &DirectStageKernels::processScalar<2>, &DirectStageKernels::processScalar<4>);
+#	  if DIRECT_STAGE_KERNELS_X86
+		run("sse", &DirectStageKernels::processSse<2>, &DirectStageKernels::processSse<4>);
+
+		if (juce::SystemStats::hasAVX2() && juce::SystemStats::hasFMA3())
+			run("avx2", &DirectStageKernels::processAvx2<2>, &DirectStageKernels::processAvx2<4>);
+#	  elif DIRECT_STAGE_KERNELS_NEON
+		run("neon", &DirectStageKernels::processNeon<2>, &DirectStageKernels::processNeon<4>);
+#	  endif
+	}
+}
+
+template<typename Stage>
+static void benchmarkFftStage(Benchmark& bench, const BenchmarkIr& ir, uint8_t numIrChannels, uint8_t numInputChannels, const char* variant, uint32_t irBlockCountLg, Stage& stage)
+{
+	const uint32_t blockSize = Stage::getBlockSize();
+
+	MemoryArena arena;
+	BenchmarkAudio audio(blockSize);
+
+	auto allocate = [&] ()
+	{
+		stage.allocateBuffers(arena, blockSize, BENCHMARK_NUM_CHANNELS, numInputChannels, BCNRVRB_LONGEST_STAGE_SIZE, irBlockCountLg);
+		stage.allocateIrBlocks(arena, blockSize, numIrChannels, 1, BCNRVRB_LONGEST_STAGE_SIZE, irBlockCountLg);
+	};
+
+	arena.beginPlan();
+	allocate();
+	arena.commit();
+	allocate();
+
+	stage.init(bench.getSamplerate(), blockSize, BENCHMARK_NUM_CHANNELS, numInputChannels, numIrChannels, ir.ir, nullptr, BCNRVRB_LONGEST_STAGE_SIZE, irBlockCountLg, kProcessingMode_OfflineSingleThread);
+	stage.updateIrBlocks(0, 0);
+
+	const float** in = audio.getIn();
+	bench.run("ConvolutionEngineFftStage::process", variant, blockSize, blockSize, [&] () { stage.process(in, audio.out, false); });
+
+	stage.exit();
+}
+
+// each stage runs on its own, with the audio block size equal to its block size (so the convolution is done on every process() call, never in the thread pool)
+template<typename Stages>
+static void benchmarkFftStages(Benchmark& bench, const BenchmarkIr& ir, uint8_t numIrChannels, uint8_t numInputChannels, const char* variant)
+{
+	auto stages = std::make_unique<Stages>();
+	const uint32_t irBlockCountLg = ConvolutionEngine::getIrBlockCountLg(ir.irLen);
+
+	std::apply([&] (auto&... stage) { (benchmarkFftStage(bench, ir, numIrChannels, numInputChannels, variant, irBlockCountLg, stage), ...); }, *stages);
+}
+
+static void benchmarkFilterBiquad(Benchmark& bench)
+{
+	BenchmarkAudio audio(BENCHMARK_FILTER_BLOCK_SIZE);
+	FilterBiquad filter;
+
+	filter.init(true);
+	filter.setTargetFreq(1000.0f, 0.0f, bench.getSamplerate());
+
+	bench.run("FilterBiquad::process", "float", BENCHMARK_FILTER_BLOCK_SIZE, BENCHMARK_FILTER_BLOCK_SIZE, [&] () { filter.process(audio.in[0], audio.out[0], BENCHMARK_FILTER_BLOCK_SIZE); });
+
+	std::unique_ptr<double[]> inDouble(new double[BENCHMARK_FILTER_BLOCK_SIZE]);
+	std::unique_ptr<double[]> outDouble(new double[BENCHMARK_FILTER_BLOCK_SIZE]);
+
+	for (uint32_t i=0; i<BENCHMARK_FILTER_BLOCK_SIZE; i++)
+		inDouble[i] = audio.in[0][i];
+
+	bench.run("FilterBiquad::process", "double", BENCHMARK_FILTER_BLOCK_SIZE, BENCHMARK_FILTER_BLOCK_SIZE, [&] () { filter.process(inDouble.get(), outDouble.get(), BENCHMARK_FILTER_BLOCK_SIZE); });
+
+	filter.exit();
+}
+
+// resampling of a whole IR (done when reconfiguring for a samplerate other than BCNRVRB_DEFAULT_IR_SAMPLERATE)
+static void benchmarkSamplerateConverter(Benchmark& bench, const BenchmarkIr& ir)
+{
+	const double samplerates[] = { 44100.0, 88200.0, 96000.0, 192000.0 };
+
+	for (double samplerateOut : samplerates)
+	{
+		const uint32_t outLen = SamplerateConverter::getOutputLength(BCNRVRB_DEFAULT_IR_SAMPLERATE, samplerateOut, ir.irLen, BCNRVRB_IR_MAX_LEN_SAMPLES);
+
+		MemoryArena arena;
+		float* out[2] = { nullptr, nullptr };
+
+		arena.beginPlan();
+		for (uint32_t ch=0; ch<2; ch++)
+			out[ch] = arena.allocate<float>(outLen);
+		arena.commit();
+		for (uint32_t ch=0; ch<2; ch++)
+			out[ch] = arena.allocate<float>(outLen);
+
+		const float* in[2] = { ir.ir[0], ir.ir[1] };
+		uint32_t outLenActual = 0;
+
+		bench.run("SamplerateConverter::convert", std::to_string(int(samplerateOut)), 0, ir.irLen, [&] ()
+		{
+			SamplerateConverter::convert(BCNRVRB_DEFAULT_IR_SAMPLERATE, samplerateOut, BENCHMARK_NUM_CHANNELS, in, out, ir.irLen, outLen, outLenActual);
+		});
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// a synthetic stereo IR, added to the IR library after the compiled-in ones (the example IRs are deltas)
+class BenchmarkIrProvider : public IrProvider
+{
+private:
+	std::vector<float> m_ir[2];
+
+public:
+	BenchmarkIrProvider(double samplerate, uint32_t len)
+	{
+		for (uint32_t ch=0; ch<2; ch++)
+		{
+			m_ir[ch].resize(len);
+			SyntheticIr::generate(m_ir[ch].data(), len, samplerate, BENCHMARK_IR_RT60_SECONDS, 1 + ch);
+		}
+	}
+
+	int getIrCount(void) override
+	{
+		return 1;
+	}
+
+	const char* getIrName(int irIndex) override
+	{
+		return "SYNTHETIC";
+	}
+
+	int getIrChannelCount(int irIndex) override
+	{
+		return 2;
+	}
+
+	double getIrSamplerate(int irIndex) override
+	{
+		return BCNRVRB_DEFAULT_IR_SAMPLERATE;
+	}
+
+	uint32_t getIrLen(int irIndex) override
+	{
+		return static_cast<uint32_t>(m_ir[0].size());
+	}
+
+	uint64_t getIrHash(int irIndex) override
+	{
+		return 0; // the disk cache is disabled (see main())
+	}
+
+	bool readIr(int irIndex, float* audio[BCNRVRB_MAX_IR_CHANNELS], uint8_t numChannels) override
+	{
+		for (uint8_t ch=0; ch<numChannels; ch++)
+			memcpy(audio[ch], m_ir[ch % 2].data(), m_ir[0].size()*sizeof(float));
+
+		return true;
+	}
+};
+
+// ConvolutionReverb internals, timed on their own (it is a friend class), with the synthetic IR
+class ConvolutionReverbBenchmark
+{
+private:
+	static inline int m_irIndex = 0;
+
+public:
+	// as long as the first compiled-in IR, so that results are comparable with previous versions
+	static uint32_t addSyntheticIr(void)
+	{
+		const uint32_t irLen = IrStore::getIrLen(0);
+
+		m_irIndex = IrStore::getIrCount();
+		IrStore::addIrProvider(std::make_unique<BenchmarkIrProvider>(BCNRVRB_DEFAULT_IR_SAMPLERATE, irLen));
+
+		return irLen;
+	}
+
+	// decayColorOnWetSignal: see ConvolutionReverb::setDecayColorOnWetSignal() (a "_wet_signal" variant)
+	static void run(Benchmark& bench, bool decayColorOnWetSignal)
+	{
+		const uint32_t irLen = IrStore::getIrLen(m_irIndex);
+		const double samplerates[] = { BCNRVRB_DEFAULT_IR_SAMPLERATE, 44100.0 };
+
+		for (double samplerate : samplerates)
+		{
+			auto reverb = std::make_unique<ConvolutionReverb>();
+			BenchmarkAudio audio(BENCHMARK_REVERB_BLOCK_SIZE);
+
+			reverb->init();
+			reverb->setDecayColorOnWetSignal(decayColorOnWetSignal);
+			reverb->setFixedBlockSize(true); // an engine for BENCHMARK_REVERB_BLOCK_SIZE blocks, not a re-blocking one
+			reverb->prepare(samplerate, true, false, BENCHMARK_REVERB_BLOCK_SIZE, m_irIndex, 1.0f, 0.0f);
+
+			auto& wet = reverb->m_wet[reverb->m_wetIndex];
+
+			if (wet.m_threadPool != nullptr)
+				wet.m_threadPool->wait(wet.m_irUpdateJob); // no process() calls from now on, so it is never submitted again
+
+			const std::string variant = std::to_string(int(samplerate)) + (decayColorOnWetSignal ? "_wet_signal" : "");
+
+			// the shared IR is released first, so that it is prepared again every time (as for the first instance using it):
+			bench.run("ConvolutionReverb::reconfigure", variant, BENCHMARK_REVERB_BLOCK_SIZE, irLen, [&] ()
+			{
+				wet.m_preparedIr = nullptr;
+				reverb->reconfigure();
+			});
+
+			// samples per call: the IR update period (its real-time factor is the share of that period used by every update)
+			float decayControl = 0.5f;
+
+			if (decayColorOnWetSignal) // the IR is never reprocessed: a decay change only updates the partition gains (and color is filtered on the wet signal)
+			{
+				bench.run("ConvolutionReverb::updateDecayGains", "decay_" + variant, 0, BCNRVRB_LONGEST_STAGE_SIZE, [&] ()
+				{
+					decayControl = (decayControl == 0.5f) ? 0.6f : 0.5f;
+
+					uint32_t decayCutPointSamples;
+					float decayEnvSmoothingFactor;
+
+					wet.getDecayEnvelope(reverb->getDecayFromDecayControl(decayControl), decayCutPointSamples, decayEnvSmoothingFactor);
+					wet.m_convolutionEngine.updateDecayGains(decayCutPointSamples, decayEnvSmoothingFactor);
+				});
+			}
+			else
+			{
+				bench.run("ConvolutionReverb::updateIr", "decay_" + variant, 0, BCNRVRB_LONGEST_STAGE_SIZE, [&] ()
+				{
+					decayControl = (decayControl == 0.5f) ? 0.6f : 0.5f;
+					wet.m_decayControl = decayControl;
+					wet.updateIr(true);
+				});
+
+				float colorControl = -0.3f;
+				bench.run("ConvolutionReverb::updateIr", "color_" + variant, 0, BCNRVRB_LONGEST_STAGE_SIZE, [&] ()
+				{
+					colorControl = (colorControl == -0.3f) ? -0.4f : -0.3f;
+					wet.m_colorControl = colorControl;
+					wet.updateIr(true);
+				});
+			}
+
+			reverb->exit();
+		}
+	}
+
+	enum ProcessScenario
+	{
+		kProcessScenario_Steady = 0,
+		kProcessScenario_DecayMoving, // the decay knob keeps moving, so the IR updater never stops
+		kProcessScenario_ShortDecay, // the decay knob is low, so most of the IR partitions are faded out and not convolved
+		kProcessScenario_SilentInput, // once the tail is over, the convolution stages idle
+	};
+
+	// process() as called by a host, in real time, with the larger stages on the DSP thread pool or time-sliced on the calling thread (only its time is measured)
+	static void runProcess(Benchmark& bench, ProcessingMode processingMode, bool decayColorOnWetSignal, ProcessScenario scenario)
+	{
+		static const char* const scenarioNames[] = { "", "_decay_moving", "_short_decay", "_silent_input" };
+		const std::string variant = std::string((processingMode == kProcessingMode_RealtimeTimeSliced) ? "time_sliced" : "threaded") + (decayColorOnWetSignal ? "_wet_signal" : "") + scenarioNames[scenario];
+		const bool decayMoving = (scenario == kProcessScenario_DecayMoving);
+		const float decayControlSteady = (scenario == kProcessScenario_ShortDecay) ? 0.2f : 0.7f;
+
+		if (!bench.isEnabled("ConvolutionReverb::process"))
+			return;
+
+		const double samplerate = bench.getSamplerate();
+		const double periodNs = BENCHMARK_CALLBACK_BLOCK_SIZE * 1.0e9 / samplerate;
+
+		auto reverb = std::make_unique<ConvolutionReverb>();
+		BenchmarkAudio audio(BENCHMARK_CALLBACK_BLOCK_SIZE);
+
+		if (scenario == kProcessScenario_SilentInput)
+		{
+			for (uint32_t ch=0; ch<2; ch++)
+				std::memset(audio.in[ch], 0, BENCHMARK_CALLBACK_BLOCK_SIZE*sizeof(float));
+		}
+
+		reverb->init();
+		reverb->setProcessingMode(processingMode);
+		reverb->setDecayColorOnWetSignal(decayColorOnWetSignal);
+		reverb->setFixedBlockSize(true); // every call is BENCHMARK_CALLBACK_BLOCK_SIZE long: no re-blocking
+		reverb->prepare(samplerate, true, false, BENCHMARK_CALLBACK_BLOCK_SIZE, m_irIndex, decayControlSteady, -0.2f);
+
+		uint32_t calls = 0;
+
+		auto process = [&] ()
+		{
+			const float decayControl = decayMoving ? 0.5f + 0.4f * float((calls / 64) % 2) : decayControlSteady;
+
+			reverb->process(audio.getIn(), audio.out, true, samplerate, BENCHMARK_CALLBACK_BLOCK_SIZE, decayControl, -0.2f, 0.0f, m_irIndex);
+			calls++;
+		};
+
+		for (uint32_t i=0; i<uint32_t(BENCHMARK_CALLBACK_WARMUP_SECONDS * samplerate / BENCHMARK_CALLBACK_BLOCK_SIZE); i++)
+			process();
+
+		// at least 4 periods of the longest stage (a full cycle of its slices):
+		bench.runCallbacks("ConvolutionReverb::process", variant, BENCHMARK_CALLBACK_BLOCK_SIZE, BENCHMARK_CALLBACK_BLOCK_SIZE, 4 * BCNRVRB_LONGEST_STAGE_SIZE / BENCHMARK_CALLBACK_BLOCK_SIZE, periodNs, process);
+
+		reverb->exit();
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void printUsage(void)
+{
+	fprintf(stderr, "Usage: BarcelonaReverberaBenchmark [--filter <name substring>] [--min-time-ms <ms per benchmark>] [--samplerate <Hz>] [--out <file.json>] [--dsp-threads <count>] [--quiet]\n");
+}
+
+int main(int argc, char* argv[])
+{
+	std::string filter;
+	std::string outPath;
+	double minTimeMs = 200.0;
+	double samplerate = BCNRVRB_DEFAULT_IR_SAMPLERATE;
+	bool verbose = true;
+
+	for (int i=1; i<argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool hasValue = (i + 1 < argc);
+
+		if ((arg == "--filter") && hasValue)
+			filter = argv[++i];
+		else if ((arg == "--min-time-ms") && hasValue)
+			minTimeMs = std::atof(argv[++i]);
+		else if ((arg == "--samplerate") && hasValue)
+			samplerate = std::atof(argv[++i]);
+		else if ((arg == "--out") && hasValue)
+			outPath = argv[++i];
+		else if ((arg == "--dsp-threads") && hasValue)
+			DspThreadPool::setNumThreads(std::atoi(argv[++i])); // before the pool is first started
+		else if (arg == "--quiet")
+			verbose = false;
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+
+	if ((minTimeMs <= 0.0) || (samplerate <= 0.0))
+	{
+		printUsage();
+		return 1;
+	}
+
+	Benchmark bench(samplerate, minTimeMs, filter, verbose);
+	const BenchmarkIr ir(samplerate, uint32_t(BENCHMARK_IR_LEN_SECONDS * samplerate));
+
+	benchmarkFft(bench);
+	benchmarkDirectStage(bench, ir, BENCHMARK_NUM_CHANNELS, BENCHMARK_NUM_CHANNELS, "");
+	benchmarkDirectStage(bench, ir, 4, BENCHMARK_NUM_CHANNELS, "true_stereo");
+	benchmarkDirectStage(bench, ir, BENCHMARK_NUM_CHANNELS, 1, "mono_input");
+	benchmarkDirectStageKernels(bench, ir);
+	benchmarkFftStages<GenerateFftStages_t<BCNRVRB_SMALLEST_STAGE_SIZE, BCNRVRB_LONGEST_STAGE_SIZE>>(bench, ir, BENCHMARK_NUM_CHANNELS, BENCHMARK_NUM_CHANNELS, "");
+	benchmarkFftStages<GenerateFftStages_t<BCNRVRB_SMALLEST_STAGE_SIZE, BCNRVRB_LONGEST_STAGE_SIZE>>(bench, ir, 4, BENCHMARK_NUM_CHANNELS, "true_stereo");
+	benchmarkFftStages<GenerateFftStages_t<BCNRVRB_SMALLEST_STAGE_SIZE, BCNRVRB_LONGEST_STAGE_SIZE>>(bench, ir, BENCHMARK_NUM_CHANNELS, 1, "mono_input");
+	benchmarkFftStages<GenerateFftStages_t<2*BCNRVRB_DIRECT_STAGE_MAX_BLOCK_SIZE, BCNRVRB_LONGEST_STAGE_SIZE, true>>(bench, ir, BENCHMARK_NUM_CHANNELS, BENCHMARK_NUM_CHANNELS, "replaces_direct_stage");
+	benchmarkFilterBiquad(bench);
+	benchmarkSamplerateConverter(bench, ir);
+
+	IrStore::setCacheDirectory(juce::File()); // the IR preparation is timed: never loaded from the disk cache
+	const uint32_t reverbIrLen = ConvolutionReverbBenchmark::addSyntheticIr();
+	// both ways of applying decay and color (see ConvolutionReverb::setDecayColorOnWetSignal()):
+	for (bool decayColorOnWetSignal : { false, true })
+	{
+		ConvolutionReverbBenchmark::run(bench, decayColorOnWetSignal);
+
+		for (auto scenario : { ConvolutionReverbBenchmark::kProcessScenario_Steady, ConvolutionReverbBenchmark::kProcessScenario_DecayMoving, ConvolutionReverbBenchmark::kProcessScenario_ShortDecay, ConvolutionReverbBenchmark::kProcessScenario_SilentInput })
+		{
+			ConvolutionReverbBenchmark::runProcess(bench, kProcessingMode_Realtime, decayColorOnWetSignal, scenario);
+			ConvolutionReverbBenchmark::runProcess(bench, kProcessingMode_RealtimeTimeSliced, decayColorOnWetSignal, scenario);
+		}
+	}
+
+	char info[256];
+	snprintf(info, sizeof(info), "\"ir_len\": %u, \"reverb_ir_len\": %u, \"ir_rt60_seconds\": %.2f, \"num_channels\": %d",
+		ir.irLen, reverbIrLen, BENCHMARK_IR_RT60_SECONDS, BENCHMARK_NUM_CHANNELS);
+
+	if (outPath.empty())
+		bench.writeJson(stdout, info);
+	else
+	{
+		FILE* file = fopen(outPath.c_str(), "w");
+
+		if (file == nullptr)
+		{
+			fprintf(stderr, "Could not open %s\n", outPath.c_str());
+			return 1;
+		}
+
+		bench.writeJson(file, info);
+		fclose(file);
+	}
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define BENCHMARK_BATCH_COUNT				(7) // the median batch is reported (robust to outliers such as interrupts)
+#define BENCHMARK_WARMUP_CALLS				(2)
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Times a function on its own, calling it in batches until a minimum time is reached. Results are written as JSON.
+// Times are given per call and per audio sample (samplesPerCall: audio samples each call accounts for), and as a real-time factor:
+// processing time / audio duration at the benchmark samplerate, on a single core (< 1.0 is faster than real time).
+class Benchmark
+{
+public:
+	struct Result
+	{
+		std::string name;
+		std::string variant;
+		uint32_t size = 0; // FFT/stage/block size, depending on the component
+		uint32_t samplesPerCall = 0;
+		uint64_t calls = 0;
+		double nsPerCall = 0.0; // median batch
+		double nsPerCallMin = 0.0; // fastest batch
+		double nsPerCallP99 = 0.0; // runCallbacks() only: 99th percentile and slowest single call
+		double nsPerCallMax = 0.0;
+	};
+
+private:
+	double m_samplerate = 48000.0;
+	double m_minTimeMs = 200.0;
+	std::string m_filter; // only benchmarks whose name contains it are run
+	bool m_verbose = true;
+
+	std::vector<Result> m_results;
+
+public:
+	Benchmark(double samplerate, double minTimeMs, const std::string& filter, bool verbose) : m_samplerate(samplerate), m_minTimeMs(minTimeMs), m_filter(filter), m_verbose(verbose) {}
+
+	inline double getSamplerate(void) const
+	{
+		return m_samplerate;
+	}
+
+	inline bool isEnabled(const std::string& name) const
+	{
+		return m_filter.empty() || (name.find(m_filter) != std::string::npos);
+	}
+
+	template<typename Func>
+	inline void run(const std::string& name, const std::string& variant, uint32_t size, uint32_t samplesPerCall, Func&& func)
+	{
+		if (!isEnabled(name))
+			return;
+
+		for (int i=0; i<BENCHMARK_WARMUP_CALLS; i++)
+			func();
+
+		// calls per batch, so that all the batches take m_minTimeMs:
+		const double batchTimeNs = m_minTimeMs * 1.0e6 / BENCHMARK_BATCH_COUNT;
+		uint64_t callsPerBatch = 1;
+
+		while (true)
+		{
+			const double timeNs = timeCalls(func, callsPerBatch);
+
+			if ((timeNs >= batchTimeNs) || (callsPerBatch >= (uint64_t(1) << 40)))
+				break;
+
+			callsPerBatch = (timeNs > 0.0)
+				? std::max(callsPerBatch + 1, uint64_t(callsPerBatch * 1.2 * batchTimeNs / timeNs))
+				: callsPerBatch * 2;
+		}
+
+		double nsPerCall[BENCHMARK_BATCH_COUNT];
+
+		for (int b=0; b<BENCHMARK_BATCH_COUNT; b++)
+			nsPerCall[b] = timeCalls(func, callsPerBatch) / double(callsPerBatch);
+
+		std::sort(nsPerCall, nsPerCall + BENCHMARK_BATCH_COUNT);
+
+		Result result;
+		result.name = name;
+		result.variant = variant;
+		result.size = size;
+		result.samplesPerCall = samplesPerCall;
+		result.calls = callsPerBatch * BENCHMARK_BATCH_COUNT;
+		result.nsPerCall = nsPerCall[BENCHMARK_BATCH_COUNT / 2];
+		result.nsPerCallMin = nsPerCall[0];
+
+		m_results.push_back(result);
+
+		if (m_verbose)
+			fprintf(stderr, "%-40s %-16s %6u: %12.1f ns/call %9.3f ns/sample RTF %.5f\n", name.c_str(), variant.c_str(), size, result.nsPerCall, getNsPerSample(result), getRealtimeFactor(result));
+	}
+
+	// times every call on its own (as audio callbacks, whose worst case matters as much as their mean), for m_minTimeMs and at least minCalls calls.
+	// The median call is reported as nsPerCall, along with the 99th percentile and the slowest one.
+	// periodNs: if not 0, a call is started every periodNs at most (as an audio device would), so that other threads' work is not timed
+	template<typename Func>
+	inline void runCallbacks(const std::string& name, const std::string& variant, uint32_t size, uint32_t samplesPerCall, uint64_t minCalls, double periodNs, Func&& func)
+	{
+		if (!isEnabled(name))
+			return;
+
+		for (int i=0; i<BENCHMARK_WARMUP_CALLS; i++)
+			func();
+
+		std::vector<double> nsPerCall;
+		double totalNs = 0.0;
+		auto nextCall = std::chrono::steady_clock::now();
+
+		while ((totalNs < m_minTimeMs * 1.0e6) || (nsPerCall.size() < minCalls))
+		{
+			if (periodNs > 0.0)
+			{
+				std::this_thread::sleep_until(nextCall);
+				nextCall += std::chrono::nanoseconds(int64_t(periodNs));
+			}
+
+			const double timeNs = timeCalls(func, 1);
+
+			nsPerCall.push_back(timeNs);
+			totalNs += (periodNs > 0.0) ? periodNs : timeNs;
+		}
+
+		std::sort(nsPerCall.begin(), nsPerCall.end());
+
+		Result result;
+		result.name = name;
+		result.variant = variant;
+		result.size = size;
+		result.samplesPerCall = samplesPerCall;
+		result.calls = nsPerCall.size();
+		result.nsPerCall = nsPerCall[nsPerCall.size() / 2];
+		result.nsPerCallMin = nsPerCall.front();
+		result.nsPerCallP99 = nsPerCall[(nsPerCall.size() * 99) / 100];
+		result.nsPerCallMax = nsPerCall.back();
+
+		m_results.push_back(result);
+
+		if (m_verbose)
+			fprintf(stderr, "%-40s %-16s %6u: %12.1f ns/call %9.3f ns/sample RTF %.5f (p99 %.1f ns, max %.1f ns)\n", name.c_str(), variant.c_str(), size, result.nsPerCall, getNsPerSample(result), getRealtimeFactor(result), result.nsPerCallP99, result.nsPerCallMax);
+	}
+
+	inline double getNsPerSample(const Result& result) const
+	{
+		return (result.samplesPerCall > 0) ? result.nsPerCall / result.samplesPerCall : 0.0;
+	}
+
+	inline double getRealtimeFactor(const Result& result) const
+	{
+		return (result.samplesPerCall > 0) ? result.nsPerCall / (result.samplesPerCall * 1.0e9 / m_samplerate) : 0.0;
+	}
+
+	// info: extra top-level members, already formatted as JSON ("key": value, ...)
+	void writeJson(FILE* file, const std::string& info) const
+	{
+		fprintf(file, "{\n");
+		fprintf(file, "\t\"samplerate\": %.1f,\n", m_samplerate);
+		fprintf(file, "\t\"min_time_ms\": %.1f,\n", m_minTimeMs);
+
+		if (!info.empty())
+			fprintf(file, "\t%s,\n", info.c_str());
+
+		fprintf(file, "\t\"results\":\n\t[\n");
+
+		for (size_t i=0; i<m_results.size(); i++)
+		{
+			const Result& r = m_results[i];
+
+			fprintf(file, "\t\t{ \"name\": \"%s\", \"variant\": \"%s\", \"size\": %u, \"samples_per_call\": %u, \"calls\": %llu, \"ns_per_call\": %.3f, \"ns_per_call_min\": %.3f, \"ns_per_call_p99\": %.3f, \"ns_per_call_max\": %.3f, \"ns_per_sample\": %.6f, \"realtime_factor\": %.8f }%s\n",
+				r.name.c_str(), r.variant.c_str(), r.size, r.samplesPerCall, (unsigned long long) r.calls, r.nsPerCall, r.nsPerCallMin, r.nsPerCallP99, r.nsPerCallMax, getNsPerSample(r), getRealtimeFactor(r), (i + 1 < m_results.size()) ? "," : "");
+		}
+
+		fprintf(file, "\t]\n}\n");
+	}
+
+private:
+	template<typename Func>
+	static inline double timeCalls(Func&& func, uint64_t calls)
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		for (uint64_t i=0; i<calls; i++)
+			func();
+
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
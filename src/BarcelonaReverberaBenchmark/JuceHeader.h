@@ -0,0 +1,8 @@
+#pragma once
+
+// Headless replacement of build/JuceLibraryCode/JuceHeader.h for the benchmark: only the JUCE modules used by the DSP code (no GUI nor plugin client).
+
+#include <juce_core/juce_core.h>
+#include <juce_audio_basics/juce_audio_basics.h>
+
+#include "BinaryData.h"
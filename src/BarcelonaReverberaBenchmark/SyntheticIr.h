@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include <cmath>
+#include <random>
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Exponentially decaying white noise: a stand-in for a real room IR (those are not in the repo), with the same cost for the engine.
+// Deterministic for a given seed, so that results are comparable between runs.
+class SyntheticIr
+{
+public:
+	// rt60Seconds: time for the envelope to decay 60 dB
+	static void generate(float* ir, uint32_t len, double samplerate, double rt60Seconds, uint32_t seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+
+		const double decayPerSample = std::pow(10.0, -3.0 / (rt60Seconds * samplerate));
+		double gain = 1.0;
+
+		for (uint32_t i=0; i<len; i++)
+		{
+			ir[i] = float(noise(rng) * gain);
+			gain *= decayPerSample;
+		}
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
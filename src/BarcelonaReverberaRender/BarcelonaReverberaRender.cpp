@@ -0,0 +1,312 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <JuceHeader.h>
+#include "ConvolutionReverb.h"
+#include "IrFileProvider.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Offline render of audio files through ConvolutionReverb (the same engine as the plugin, in non-realtime mode), one file per thread.
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct RenderSettings
+{
+	int irIndex = 0;
+	float decayControl = 1.0f; // same ranges and defaults as the plugin parameters
+	float colorControl = 0.0f;
+	float dryWetControl = 0.0f;
+	bool decayColorOnWetSignal = false; // see ConvolutionReverb::setDecayColorOnWetSignal()
+	int blockSize = BCNRVRB_MAX_BLOCK_SIZE; // large blocks: fewer, larger stages (latency does not matter offline)
+	int bitsPerSample = 24;
+	juce::File outDir; // next to each input file if not set
+	juce::String suffix = "_reverb";
+};
+
+// renders the input file followed by the full reverb tail into a WAV file. Returns an error message (empty on success)
+static juce::String renderFile(const juce::File& inFile, const RenderSettings& settings, double& audioSeconds)
+{
+	juce::ScopedNoDenormals noDenormals;
+
+	juce::AudioFormatManager formatManager;
+	formatManager.registerBasicFormats();
+
+	std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(inFile));
+
+	if (reader == nullptr)
+		return "could not read the file (unsupported format?)";
+
+	const int numChannels = static_cast<int>(reader->numChannels);
+	const double samplerate = reader->sampleRate;
+
+	if ((numChannels < 1) || (numChannels > 2))
+		return "only mono and stereo files are supported";
+
+	if ((samplerate <= 0.0) || (samplerate > BCNRVRB_MAX_SAMPLERATE))
+		return "unsupported samplerate";
+
+	const int blockSize = settings.blockSize;
+	const int64_t inputLen = reader->lengthInSamples;
+	const int64_t outputLen = inputLen + ConvolutionReverb::getTailLengthSamples(settings.irIndex, samplerate);
+	const int64_t bufferLen = ((outputLen + blockSize - 1) / blockSize) * blockSize;
+
+	if (bufferLen > std::numeric_limits<int>::max())
+		return "file too long";
+
+	juce::AudioBuffer<float> audio(numChannels, static_cast<int>(bufferLen)); // rendered in place: each block is read before being overwritten
+	audio.clear();
+	reader->read(&audio, 0, static_cast<int>(inputLen), 0, true, true);
+
+	std::vector<float> blockOut(2 * blockSize); // process() writes both output channels, even when mono
+
+	auto reverb = std::make_unique<ConvolutionReverb>();
+	reverb->init();
+	reverb->setProcessingMode(kProcessingMode_OfflineSingleThread); // files are already rendered in parallel
+	reverb->setDecayColorOnWetSignal(settings.decayColorOnWetSignal);
+	reverb->setFixedBlockSize(true); // every block is blockSize long: no latency if it is a multiple of the internal block size
+	reverb->prepare(samplerate, (numChannels > 1), false, blockSize, settings.irIndex, settings.decayControl, settings.colorControl);
+
+	for (int start=0; start<bufferLen; start+=blockSize)
+	{
+		const float* audioIn[2] = { audio.getReadPointer(0, start), audio.getReadPointer(numChannels - 1, start) };
+		float* audioOut[2] = { &blockOut[0], &blockOut[blockSize] };
+
+		reverb->process(audioIn, audioOut, (numChannels > 1), samplerate, blockSize, settings.decayControl, settings.colorControl, settings.dryWetControl, settings.irIndex);
+
+		for (int ch=0; ch<numChannels; ch++)
+			audio.copyFrom(ch, start, audioOut[ch], blockSize);
+	}
+
+	reverb->exit();
+
+	const juce::File outDir = (settings.outDir == juce::File()) ? inFile.getParentDirectory() : settings.outDir;
+	const juce::File outFile = outDir.getChildFile(inFile.getFileNameWithoutExtension() + settings.suffix + ".wav");
+
+	outFile.deleteFile();
+
+	std::unique_ptr<juce::FileOutputStream> outStream(outFile.createOutputStream());
+
+	if ((outStream == nullptr) || outStream->failedToOpen())
+		return "could not create " + outFile.getFullPathName();
+
+	juce::WavAudioFormat wavFormat;
+	std::unique_ptr<juce::AudioFormatWriter> writer(wavFormat.createWriterFor(outStream.get(), samplerate, static_cast<unsigned int>(numChannels), settings.bitsPerSample, {}, 0));
+
+	if (writer == nullptr)
+		return "could not write " + outFile.getFullPathName();
+
+	outStream.release(); // owned by the writer
+
+	if (!writer->writeFromAudioSampleBuffer(audio, 0, static_cast<int>(outputLen)))
+		return "could not write " + outFile.getFullPathName();
+
+	audioSeconds = double(outputLen) / samplerate;
+
+	return {};
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void printUsage(void)
+{
+	fprintf(stderr,
+		"Usage: BarcelonaReverberaRender [options] <input files...>\n"
+		"  --ir <1..%d>            impulse response (see --list-irs), 1 by default\n"
+		"  --ir-dir <dir>          adds the audio files in dir (and its subfolders) to the impulse responses\n"
+		"  --noise-floor-margin <dB>  IRs are cut where their decay falls to this above their noise floor, %.0f by default\n"
+		"  --decay <0..1>          1 by default\n"
+		"  --color <-1..1>         0 by default\n"
+		"  --dry-wet <-1..1>       0 by default\n"
+		"  --decay-color-on-wet    decay and color applied to the wet signal (the IR spectra are then prepared once for all the files)\n"
+		"  --out-dir <dir>         output directory (next to each input file by default)\n"
+		"  --suffix <text>         appended to the output file names, \"_reverb\" by default\n"
+		"  --bits <16|24|32>       output WAV bit depth (32: float), 24 by default\n"
+		"  --block-size <samples>  internal block size (power of 2, %d..%d), %d by default\n"
+		"  --jobs <n>              files rendered in parallel, one per core by default\n"
+		"  --list-irs              print the impulse responses and exit\n",
+		ConvolutionReverb::getIrCount(), double(BCNRVRB_IR_NOISE_FLOOR_MARGIN_DB), BCNRVRB_MIN_BLOCK_SIZE, BCNRVRB_MAX_BLOCK_SIZE, BCNRVRB_MAX_BLOCK_SIZE);
+}
+
+static bool parseFloat(const char* text, float min, float max, float& value)
+{
+	char* end = nullptr;
+	const float parsed = std::strtof(text, &end);
+
+	if ((end == text) || (*end != '\0') || !(parsed >= min) || !(parsed <= max))
+		return false;
+
+	value = parsed;
+	return true;
+}
+
+static bool parseInt(const char* text, int min, int max, int& value)
+{
+	char* end = nullptr;
+	const long parsed = std::strtol(text, &end, 10);
+
+	if ((end == text) || (*end != '\0') || (parsed < min) || (parsed > max))
+		return false;
+
+	value = static_cast<int>(parsed);
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	RenderSettings settings;
+	std::vector<juce::File> inFiles;
+	int numJobs = juce::SystemStats::getNumCpus();
+	const juce::File currentDir = juce::File::getCurrentWorkingDirectory();
+	const char* irArg = nullptr;
+	bool listIrs = false;
+
+	for (int i=1; i<argc; i++)
+	{
+		const std::string arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+		bool valid = true;
+
+		if (arg == "--list-irs")
+		{
+			listIrs = true;
+			continue;
+		}
+		else if (arg == "--decay-color-on-wet")
+		{
+			settings.decayColorOnWetSignal = true;
+			continue;
+		}
+		else if (arg.rfind("--", 0) != 0)
+		{
+			inFiles.push_back(currentDir.getChildFile(arg));
+			continue;
+		}
+		else if (value == nullptr)
+			valid = false;
+		else if (arg == "--ir")
+			irArg = value; // checked once all the IR folders are added
+		else if (arg == "--ir-dir")
+		{
+			const juce::File irDir = currentDir.getChildFile(value);
+			valid = irDir.isDirectory();
+
+			if (valid)
+				IrStore::addIrProvider(std::make_unique<IrFileProvider>(irDir));
+		}
+		else if (arg == "--noise-floor-margin")
+		{
+			float marginDb = 0.0f;
+			valid = parseFloat(value, 0.0f, 60.0f, marginDb);
+
+			if (valid)
+				IrStore::setNoiseFloorMargin(marginDb);
+		}
+		else if (arg == "--decay")
+			valid = parseFloat(value, 0.0f, 1.0f, settings.decayControl);
+		else if (arg == "--color")
+			valid = parseFloat(value, -1.0f, 1.0f, settings.colorControl);
+		else if (arg == "--dry-wet")
+			valid = parseFloat(value, -1.0f, 1.0f, settings.dryWetControl);
+		else if (arg == "--out-dir")
+			settings.outDir = currentDir.getChildFile(value);
+		else if (arg == "--suffix")
+			settings.suffix = value;
+		else if (arg == "--bits")
+			valid = parseInt(value, 16, 32, settings.bitsPerSample) && ((settings.bitsPerSample == 16) || (settings.bitsPerSample == 24) || (settings.bitsPerSample == 32));
+		else if (arg == "--block-size")
+			valid = parseInt(value, BCNRVRB_MIN_BLOCK_SIZE, BCNRVRB_MAX_BLOCK_SIZE, settings.blockSize) && DspUtils::isPowOf2(settings.blockSize);
+		else if (arg == "--jobs")
+			valid = parseInt(value, 1, 1024, numJobs);
+		else
+			valid = false;
+
+		if (!valid)
+		{
+			printUsage();
+			return 1;
+		}
+
+		i++; // the option's value
+	}
+
+	if (listIrs)
+	{
+		for (int ir=0; ir<ConvolutionReverb::getIrCount(); ir++)
+			printf("%d: %s\n", ir + 1, ConvolutionReverb::getIrName(ir));
+
+		return 0;
+	}
+
+	if (irArg != nullptr)
+	{
+		if (!parseInt(irArg, 1, ConvolutionReverb::getIrCount(), settings.irIndex))
+		{
+			printUsage();
+			return 1;
+		}
+
+		settings.irIndex--;
+	}
+
+	if (inFiles.empty())
+	{
+		printUsage();
+		return 1;
+	}
+
+	if ((settings.outDir != juce::File()) && settings.outDir.createDirectory().failed())
+	{
+		fprintf(stderr, "Could not create %s\n", settings.outDir.getFullPathName().toRawUTF8());
+		return 1;
+	}
+
+	// each worker takes the next file until none are left (the prepared IR is shared between them, see IrStore):
+	std::atomic<size_t> nextFile = 0;
+	std::atomic<int> numFailed = 0;
+	std::mutex printMutex;
+
+	auto worker = [&] ()
+	{
+		for (size_t i=nextFile++; i<inFiles.size(); i=nextFile++)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			double audioSeconds = 0.0;
+
+			const juce::String error = renderFile(inFiles[i], settings, audioSeconds);
+
+			const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			std::lock_guard<std::mutex> lock(printMutex);
+
+			if (error.isEmpty())
+				fprintf(stderr, "%s: %.1f s rendered in %.2f s\n", inFiles[i].getFullPathName().toRawUTF8(), audioSeconds, seconds);
+			else
+			{
+				fprintf(stderr, "%s: %s\n", inFiles[i].getFullPathName().toRawUTF8(), error.toRawUTF8());
+				numFailed++;
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+
+	for (int i=1; i<juce::jmin(numJobs, static_cast<int>(inFiles.size())); i++)
+		workers.emplace_back(worker);
+
+	worker();
+
+	for (auto& thread : workers)
+		thread.join();
+
+	return (numFailed == 0) ? 0 : 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
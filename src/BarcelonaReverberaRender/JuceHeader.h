@@ -0,0 +1,9 @@
+#pragma once
+
+// Headless replacement of build/JuceLibraryCode/JuceHeader.h for the render tool: the JUCE modules used by the DSP code, plus audio file reading/writing.
+
+#include <juce_core/juce_core.h>
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_audio_formats/juce_audio_formats.h>
+
+#include "BinaryData.h"